@@ -0,0 +1,76 @@
+import os
+import struct
+from argparse import ArgumentParser
+
+import requests
+from PIL import Image
+
+HEADER = struct.Struct("<4sB3xII")
+TIMESTAMP = struct.Struct("<I")
+
+
+def decode(data):
+    magic, version, pixel_count, frame_count = HEADER.unpack_from(data)
+    if magic != b"LLCF" or version != 1:
+        raise ValueError(f"Not a frame capture (magic {magic}, version {version}).")
+
+    frame_size = TIMESTAMP.size + pixel_count * 3
+    frames = []
+    for i in range(frame_count):
+        offset = HEADER.size + i * frame_size
+        timestamp, = TIMESTAMP.unpack_from(data, offset)
+        frames.append((timestamp, data[offset + TIMESTAMP.size:offset + frame_size]))
+
+    return pixel_count, frames
+
+
+def run(args):
+    os.makedirs(args.output, exist_ok=True)
+
+    if args.file:
+        with open(args.file, "rb") as f:
+            data = f.read()
+    else:
+        data = requests.get(f"http://{args.ip}/capture").content
+        with open(os.path.join(args.output, "capture.bin"), "wb") as f:
+            f.write(data)
+
+    pixel_count, frames = decode(data)
+    if not frames:
+        print("No frames captured. Start a capture with POST /capture first.")
+        return
+
+    # One row per frame, oldest on top
+    timeline = Image.frombytes("RGB", (pixel_count, len(frames)), b"".join(rgb for _, rgb in frames))
+    timeline.save(os.path.join(args.output, "timeline.png"))
+
+    if args.width:
+        height = -(-pixel_count // args.width)
+        for i, (timestamp, rgb) in enumerate(frames):
+            rgb += bytes(args.width * height * 3 - len(rgb))
+            Image.frombytes("RGB", (args.width, height), rgb)\
+                .save(os.path.join(args.output, f"frame_{i:05d}.png"))
+
+    # Timestamps are micros() and wrap around after ~71 minutes
+    deltas = [(b - a) & 0xFFFFFFFF for (a, _), (b, _) in zip(frames, frames[1:])]
+    print(f"{len(frames)} frames of {pixel_count} pixels", end='')
+    if deltas:
+        print(f", {sum(deltas) / len(deltas) / 1000:.2f}ms apart on average (max {max(deltas) / 1000:.2f}ms)", end='')
+    print(".")
+
+
+def setup(command: ArgumentParser):
+    command.add_argument(
+        "--file",
+        help="Decode a capture downloaded before, instead of downloading one."
+    )
+    command.add_argument(
+        "--output", default="capture",
+        help="Directory to write images into."
+    )
+    command.add_argument(
+        "--width",
+        type=int, default=0,
+        help="If set, also write each frame as an image of this width."
+    )
+    command.set_defaults(func=run)
@@ -4,6 +4,7 @@ import os
 import sys
 
 import observe_log
+import decode_capture
 
 assert (3, 0) <= sys.version_info
 
@@ -24,6 +25,10 @@ observe_log.setup(commands.add_parser(
     "observe-log", help="Actively observe the log."
 ))
 
+decode_capture.setup(commands.add_parser(
+    "decode-capture", help="Download a frame capture and turn it into images."
+))
+
 
 def run_main(args):
     try:
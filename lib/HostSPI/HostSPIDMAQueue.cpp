@@ -0,0 +1,35 @@
+#include <util/spi/SPIDMAQueue.h>
+#include <algorithm>
+
+// There is no SPI bus on the host. Buffers live on the heap,
+// and transactions are done as soon as they are queued.
+
+SPIDMAQueue::SPIDMAQueue(spi_host_device_t host, int dmaChannel, int dataPin, int clockPin, int clockSpeedHz,
+                         size_t bufferSize, size_t queueDepth)
+: bufferSize(bufferSize), queueDepth(std::max(queueDepth, size_t(1))) {
+    SPI_settings.host = host;
+    SPI_settings.dma_chan = dmaChannel;
+    SPI_settings.buscfg.mosi_io_num = dataPin;
+    SPI_settings.buscfg.sclk_io_num = clockPin;
+    SPI_settings.devcfg.clock_speed_hz = clockSpeedHz;
+
+    buffers = new uint8_t*[this->queueDepth];
+    for (size_t i = 0; i < this->queueDepth; ++i)
+        buffers[i] = new uint8_t[bufferSize]{0};
+
+    transactions = new spi_transaction_t[this->queueDepth]{};
+}
+
+unsigned long SPIDMAQueue::acquire() {
+    transactionsInFlight = 0;
+    return 0;
+}
+
+void SPIDMAQueue::transmit(size_t length) {
+    spi_transaction_t *transaction = transactions + currentTransaction;
+    *transaction = {};
+    transaction->length = length * 8;
+    transaction->tx_buffer = buffer();
+
+    currentTransaction = (currentTransaction + 1) % queueDepth;
+}
@@ -5,19 +5,26 @@
 #include "App.h"
 
 #ifdef FastLED_LED_TYPE
+#include <type_traits>
 #include "util/spi/ESP32SPI.h"
+#include "util/spi/ESP32Apa102Controller.h"
 #include <screen/FastLEDRenderer.h>
 #endif
 
 #include <SPIFFS.h>
+#include <Esp.h>
 #include <network/Network.h>
 #include <screen/Apa102Renderer.h>
+#include <screen/I2SParallelRenderer.h>
+#include <screen/ClocklessSPIRenderer.h>
+#include <screen/StaticRenderer.h>
 
 #include <util/Logger.h>
 #include <util/LUT.h>
 #include <screen/behavior/Behaviors.h>
 
 #define MICROSECONDS_PER_FRAME (1000 * 1000 / MAX_FRAMES_PER_SECOND)
+#define MILLISECONDS_PER_HOUSEKEEPING 10
 
 App::App() {
     SerialLog.print("Booting LLED WiFi Firmware").ln();
@@ -50,23 +57,83 @@ App::App() {
     // Initialize Screen
 
 #ifdef FastLED_LED_TYPE
-    auto controller = new FastLED_LED_TYPE<LED_DATA_PIN, LED_CLOCK_PIN, COLOR_ORDER, DATA_RATE_MHZ(LED_CLOCK_SPEED_MHZ)>();
+    typedef FastLED_LED_TYPE<LED_DATA_PIN, LED_CLOCK_PIN, COLOR_ORDER, DATA_RATE_MHZ(LED_CLOCK_SPEED_MHZ)> Controller;
+    // Other chipsets frame differently, if they use SPI at all
+    static_assert(
+        !(std::is_same<Controller, APA102Controller<LED_DATA_PIN, LED_CLOCK_PIN, COLOR_ORDER, DATA_RATE_MHZ(LED_CLOCK_SPEED_MHZ)>>::value
+            || std::is_same<Controller, ESP32Apa102Controller<LED_DATA_PIN, LED_CLOCK_PIN, COLOR_ORDER, DATA_RATE_MHZ(LED_CLOCK_SPEED_MHZ)>>::value)
+        || SPI_BUFFER_SIZE >= APA102_FRAME_SIZE(LED_COUNT + LED_OVERFLOW_WALL),
+        "SPI_BUFFER_SIZE is too small for an APA102 frame of LED_COUNT + LED_OVERFLOW_WALL"
+    );
+    auto controller = new Controller();
     auto renderer = new FastLEDRenderer(LED_COUNT, LED_OVERFLOW_WALL, controller);
+    renderer->setMaxDynamicColorRescale(MAX_DYNAMIC_COLOR_RESCALE);
+#elif defined(I2S_PARALLEL_PINS)
+    const int pins[] = { I2S_PARALLEL_PINS };
+    auto renderer = new I2SParallelRenderer(LED_COUNT, LED_OVERFLOW_WALL, pins, sizeof(pins) / sizeof(int));
+    SerialLog.print(
+        "Attaching I2S Parallel Renderer with "
+        + String(renderer->pixelCount)
+        + " pixels on " + String(renderer->laneCount) + " strips."
+    ).ln();
+#elif defined(STATIC_RENDERER)
+#ifdef MAX_AMPERE
+    auto renderer = new StaticRenderer<STATIC_RENDERER, LED_COUNT, true>(LED_OVERFLOW_WALL, LED_DATA_PIN, LED_CLOCK_PIN);
 #else
-    auto renderer = new Apa102Renderer(LED_COUNT, LED_OVERFLOW_WALL);
+    auto renderer = new StaticRenderer<STATIC_RENDERER, LED_COUNT, false>(LED_OVERFLOW_WALL, LED_DATA_PIN, LED_CLOCK_PIN);
+#endif
+    SerialLog.print(
+        "Attaching Static Renderer with "
+        + String(renderer->pixelCount)
+        + " + " + String(LED_OVERFLOW_WALL) + " pixels."
+    ).ln();
+#elif defined(CLOCKLESS_SPI_RENDERING)
+    auto renderer = new ClocklessSPIRenderer(LED_COUNT, LED_OVERFLOW_WALL, LED_DATA_PIN, CLOCKLESS_SPI_QUEUE_DEPTH);
+    SerialLog.print(
+        "Attaching Clockless SPI Renderer with "
+        + String(renderer->pixelCount)
+        + " + " + String(LED_OVERFLOW_WALL) + " pixels."
+    ).ln();
+#else
+    auto renderer = new Apa102Renderer(LED_COUNT, LED_OVERFLOW_WALL, APA102_DMA_QUEUE_DEPTH);
+    renderer->setFusedKernel(APA102_FUSED_KERNEL || COMPACT_RENDERING);
+    renderer->setDithering(APA102_TEMPORAL_DITHERING && !COMPACT_RENDERING);
     SerialLog.print(
         "Attaching Apa102 Renderer with "
         + String(renderer->pixelCount)
         + " + " + String(LED_OVERFLOW_WALL)
-        + " pixels."
+        + " pixels on " + String(renderer->busCount) + " bus(es)."
     ).ln();
+    renderer->setMaxDynamicColorRescale(MAX_DYNAMIC_COLOR_RESCALE);
 #endif
     renderer->setColorCorrection(0xFFB0F0);
-    renderer->setMaxDynamicColorRescale(MAX_DYNAMIC_COLOR_RESCALE);
 
     screen = new Screen(renderer);
+    screens.push_back(screen);
+
+#ifdef SECOND_SCREEN_DATA_PIN
+#ifdef LED_DATA_PIN_2
+#error "SECOND_SCREEN_DATA_PIN and LED_DATA_PIN_2 both need VSPI."
+#endif
+    // Separate config files, so it keeps its own brightness etc.
+    auto secondRenderer = new ClocklessSPIRenderer(
+        SECOND_SCREEN_LED_COUNT, LED_OVERFLOW_WALL, SECOND_SCREEN_DATA_PIN,
+        CLOCKLESS_SPI_QUEUE_DEPTH, VSPI_HOST, 1
+    );
+    screens.push_back(new Screen(secondRenderer, "screen1-"));
+    SerialLog.print(
+        "Attaching second screen with "
+        + String(secondRenderer->pixelCount) + " clockless pixels."
+    ).ln();
+#endif
+
+    SerialLog.print(
+        "Renderer uses " + String(renderer->bytesPerPixel()) + " bytes per LED; "
+        + "free heap fits " + String(ESP.getFreeHeap() / renderer->bytesPerPixel()) + " more."
+    ).ln();
     // Startup Animation
-    screen->behavior = new Ping(2000 * 1000);
+    for (auto s : screens)
+        s->behavior = new Ping(2000 * 1000);
 
 #ifdef MAX_AMPERE
     float peakAmpereDrawn = (LED_COUNT) * AMPERE_PER_LED;
@@ -74,15 +141,25 @@ App::App() {
         float allowedRatio = float(MAX_AMPERE) / peakAmpereDrawn;
         // Each LED has a lightness of 3 (r+g+b)
         screen->renderer->setMaxLightness(float((LED_COUNT) * 3) * allowedRatio);
+        screen->renderer->setMaxLightnessRamp(MAX_AMPERE_RAMP);
     }
 #endif
 
     pairPin = PAIR_PIN;
     pinMode(pairPin, INPUT_PULLUP);
 
+    std::vector<Renderer *> renderers;
+    for (auto s : screens)
+        renderers.push_back(s->renderer);
+    planner = new FramePlanner(renderers, regularClock, MICROSECONDS_PER_FRAME, FRAME_PLAN_HEADROOM);
+
+    // From now on, only the render task may touch the screens
+    renderTask = new RenderTask(screens, regularClock, planner);
+    renderTask->start(RENDER_TASK_CORE, RENDER_TASK_PRIORITY, RENDER_TASK_STACK_SIZE);
+
 #ifdef WIFI_ENABLED
     // Initialize Server
-    artnetServer = new ArtnetServer(screen);
+    artnetServer = new ArtnetServer(screens);
     updater = new Updater();
 
     server = new HttpServer(this);
@@ -90,13 +167,18 @@ App::App() {
 }
 
 void App::run() {
-    auto delayMicros = regularClock->sync();
-
-    screen->update(delayMicros);
+    // Frames are handled by renderTask; this is only housekeeping.
+    delay(MILLISECONDS_PER_HOUSEKEEPING);
+    unsigned long delayMicros = MILLISECONDS_PER_HOUSEKEEPING * 1000;
 
     if (delayMicros > timeUntilSlowUpdate) {
         timeUntilSlowUpdate = 1000 * 1000 * 2;
 
+        // Brightness changes come in bursts, and writing stalls;
+        // so not from the render task, and not for every change
+        for (auto s : screens)
+            s->writeConfig();
+
 #ifdef WIFI_ENABLED
         if (digitalRead(pairPin) == LOW) {
             Network::pair();
@@ -107,6 +189,7 @@ void App::run() {
         timeUntilSlowUpdate -= delayMicros;
 
 #ifdef WIFI_ENABLED
+    artnetServer->update();
     updater->handle();
 #endif
 }
@@ -11,9 +11,14 @@
 #include <network/ArtnetServer.h>
 #include <util/RegularClock.h>
 #include <network/Updater.h>
+#include <screen/RenderTask.h>
+
+#include <vector>
 
 class App {
 public:
+    // All screens, each with its own renderer; the first one is the main one
+    std::vector<Screen *> screens;
     Screen *screen;
 
     HttpServer *server;
@@ -22,13 +27,15 @@ public:
     Updater *updater;
 
     RegularClock *regularClock;
+    FramePlanner *planner;
+    RenderTask *renderTask;
 
     App();
 
     void run();
 
     int pairPin;
-    int timeUntilSlowUpdate = 1000;
+    unsigned long timeUntilSlowUpdate = 1000;
 };
 
 
@@ -10,6 +10,17 @@
 // ------------------------------------------
 
 #define MAX_FRAMES_PER_SECOND 10000
+// The actual frame rate is planned from what the output can sustain;
+// frame time is kept this much above that, against jitter. See /budget.
+#define FRAME_PLAN_HEADROOM 1.2f
+
+// Frames are rendered on a dedicated task, away from the arduino loop.
+// Core 1 is shared with arduino and AsyncTCP, core 0 with WiFi.
+// System tasks on core 0 all run above this; the task sleeps
+// between frames, so anything below it gets to run then.
+#define RENDER_TASK_CORE 0
+#define RENDER_TASK_PRIORITY 1
+#define RENDER_TASK_STACK_SIZE 8192
 
 // ------------------------------------------
 // ---- Wifi
@@ -20,6 +31,12 @@
 #define HOST_NETWORK_PASSWORD "We love LED"
 #define WIFI_HOSTNAME "lled.wifi"
 
+// Art-Net: After an ArtSync, frames are only shown on the next ArtSync.
+// Without one for this long, they're shown once all universes are in.
+#define ART_SYNC_TIMEOUT_MICROS (4000 * 1000)
+// Art-Net: A frame still missing universes after this long is shown anyway.
+#define ART_NET_FRAME_TIMEOUT_MICROS (100 * 1000)
+
 // ------------------------------------------
 // ---- Screen
 // ------------------------------------------
@@ -31,6 +48,12 @@
 // Max 80, higher values need shorter wire length
 #define LED_CLOCK_SPEED_MHZ 60
 
+// Apa102 only: Define both to split the strip across a second SPI bus,
+// doubling output bandwidth. The first half of the pixels is sent over
+// the pins above, the second half over these.
+//#define LED_DATA_PIN_2 23
+//#define LED_CLOCK_PIN_2 18
+
 #define LED_COUNT 256
 // How many additional LEDs we should set to black, just to be safe
 #define LED_OVERFLOW_WALL 0
@@ -40,22 +63,91 @@
 // into a scale where we have better resolution.
 #define MAX_DYNAMIC_COLOR_RESCALE 8
 
+// Apa102 only: If true, encode pixels straight into the SPI buffer
+// in one pass, instead of going through an intermediate buffer.
+#define APA102_FUSED_KERNEL true
+
+// Apa102 only: Number of DMA buffers to cycle through.
+// With 2 or more, the next frame is encoded while the last one is sent.
+#define APA102_DMA_QUEUE_DEPTH 2
+
+// Apa102 only: If true, carry color remainders over to following frames.
+// Gains effective color depth for dark colors, at the cost of 3 bytes per LED.
+// Frames with remainders left are rendered even if nothing changed.
+#define APA102_TEMPORAL_DITHERING false
+
+// Apa102 only: If true, render with as little memory as possible,
+// overriding the above. Uses the fused kernel and no dithering.
+#define COMPACT_RENDERING false
+
 // Natural, or rather "minimum" response of LEDs.
 #define NATURAL_COLOR_RESPONSE 2.2f
 
+// Define to drive a second, independent clockless strip (e.g. WS2812)
+// from VSPI, with its own behavior, brightness and Art-Net nets (2 and 3).
+// Select it with the 'screen' parameter (1) in the web interface.
+// Can't be used with LED_DATA_PIN_2, which takes VSPI for Apa102.
+//#define SECOND_SCREEN_DATA_PIN 12
+#define SECOND_SCREEN_LED_COUNT 60
+
+// Brightness and response changes from the web interface
+// fade in over this time.
+#define MICROS_BRIGHTNESS_FADE (300 * 1000)
+
+// Frame capture (POST /capture) takes at most this share of free heap,
+// and skips frames while less than CAPTURE_MIN_FREE_HEAP bytes are free.
+#define CAPTURE_HEAP_RATIO 0.5f
+#define CAPTURE_MIN_FREE_HEAP (32 * 1024)
+
+// ------------------------------------------
+// ---- I2S Parallel
+// ------------------------------------------
+
+// Define to drive up to 8 clockless strips (e.g. WS2812, GRB) in parallel
+// using I2S. The pixels are split evenly across the pins, in order.
+// If FastLED is in use, don't define.
+//#define I2S_PARALLEL_PINS 16, 17, 21, 22
+
+// ------------------------------------------
+// ---- Clockless SPI
+// ------------------------------------------
+
+// Define to drive one clockless strip (e.g. WS2812, GRB) from LED_DATA_PIN,
+// encoded into an SPI bitstream and sent by DMA in the background.
+// Unlike FastLED, rendering doesn't block or disable interrupts.
+// If FastLED or I2S Parallel is in use, don't define.
+//#define CLOCKLESS_SPI_RENDERING
+
+// Number of DMA buffers to cycle through.
+// With 2 or more, the next frame is encoded while the last one is sent.
+#define CLOCKLESS_SPI_QUEUE_DEPTH 2
+
+// ------------------------------------------
+// ---- Static Rendering
+// ------------------------------------------
+
+// Define to render one strip through a pipeline fixed at compile time
+// (chipset, color order, LED_COUNT, power limit), fully inlined.
+// No partial frames or dithering, but less work per frame.
+// Value: Output stage and wire color order; see StaticRenderer.h.
+// If FastLED, I2S Parallel or Clockless SPI is in use, don't define.
+//#define STATIC_RENDERER Apa102Output, BGROrder
+//#define STATIC_RENDERER ClocklessOutput, GRBOrder
+
 // ------------------------------------------
 // ---- FastLED
 // ------------------------------------------
 
 // Define to use FastLED. If Apa102 is used, don't define.
 // See https://github.com/FastLED/FastLED/blob/master/chipsets.h
-// APA102Controller recommended, WS2013 etc. work too
-//#define FastLED_LED_TYPE APA102Controller
+// For APA102, ESP32Apa102Controller writes each frame in one block;
+// APA102Controller, WS2013 etc. work too
+//#define FastLED_LED_TYPE ESP32Apa102Controller
 #define COLOR_ORDER BGR
 
 // In bytes
-// 2 words per LED, + some boundary + buffer
-#define SPI_BUFFER_SIZE (4 * LED_COUNT + 100)
+// 1 word per LED, + start and end frames + buffer
+#define SPI_BUFFER_SIZE (4 * (LED_COUNT + LED_OVERFLOW_WALL) + (LED_COUNT + LED_OVERFLOW_WALL) / 16 + 100)
 
 // Set to a valid SPI host to route all SPI outputs to this
 #define SPI_ESP32_HARDWARE_SPI_HOST HSPI_HOST
@@ -67,6 +159,9 @@
 // If the power supply is limited, define this to dynamically limit drawn power
 #define MAX_AMPERE 1
 #define AMPERE_PER_LED 0.06
+// When the power limit relaxes, brighten up by at most this much (of 255) per frame.
+// Smooths out limiter pumping. 0 to brighten up immediately.
+#define MAX_AMPERE_RAMP 0
 
 #define PAIR_PIN 27
 
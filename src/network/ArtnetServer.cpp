@@ -5,10 +5,12 @@
 #include <util/Logger.h>
 #include "ArtnetServer.h"
 
+#include <esp32-hal.h>
+#include <Setup.h>
+
 using namespace std::placeholders;
 
-ArtnetServer::ArtnetServer(Screen *screen)
-: screen(screen) {
+ArtnetServer::ArtnetServer(const std::vector<Screen *> &screens) {
     artnet = new AsyncArtnet<ArtnetEndpoint>();
 
 #ifdef RTTI_SUPPORTED
@@ -17,11 +19,36 @@ ArtnetServer::ArtnetServer(Screen *screen)
 #define VISUAL_CLASS ArtnetEndpoint
 #endif
 
-    artnet->channels->push_back(new VISUAL_CLASS(
-        0,
-        screen->getPixelCount(),
-        "Pixels"
-    ));
+    for (size_t i = 0; i < screens.size(); ++i) {
+        auto screen = screens[i];
+        if (!screen->input)
+            // One more, always black, for the topology
+            screen->input = new TripleBuffer<PRGB>(screen->bufferSize + 1);
+
+        // Keep the names of the first screen, for existing setups
+        String suffix = i == 0 ? String() : String(" (Screen ") + String(int(i)) + ")";
+
+        Output output = {
+            screen, nullptr, nullptr,
+            Stage((screen->bufferSize * sizeof(PRGB) + 511) / 512),
+            Stage((screen->bufferSize * sizeof(PRGB16) + 511) / 512)
+        };
+        output.pixels = new VISUAL_CLASS(
+            i * 2,
+            screen->getLogicalPixelCount(),
+            String("Pixels") + suffix
+        );
+        artnet->channels->push_back(output.pixels);
+
+        output.pixels16 = new VISUAL_CLASS(
+            i * 2 + 1,
+            screen->getLogicalPixelCount() * 2,
+            String("Pixels (16 bit)") + suffix
+        );
+        artnet->channels->push_back(output.pixels16);
+
+        outputs.push_back(output);
+    }
 
     artnet->artDmxCallback = std::bind(&ArtnetServer::acceptDMX, this, _1);
     artnet->artSyncCallback = std::bind(&ArtnetServer::acceptSync, this, _1);
@@ -42,22 +69,177 @@ void ArtnetServer::acceptDMX(ArtnetChannelPacket<ArtnetEndpoint> *packet) {
         return;
     }
 
-    uint8_t *buffer = reinterpret_cast<uint8_t *>(screen->buffer);
-    int bufferSize = screen->bufferSize * 3;
+    for (auto &output : outputs) {
+        // Only allocate once someone actually uses it, and not
+        // in the critical section. One more, always black, for the topology.
+        if (rawEndpoint == output.pixels16 && !output.screen->input16)
+            output.screen->input16 = new TripleBuffer<PRGB16>(output.screen->bufferSize + 1);
+    }
+
+    portENTER_CRITICAL(&_stageMux);
+    for (auto &output : outputs) {
+        if (rawEndpoint == output.pixels)
+            accept8(output, packet);
+        else if (rawEndpoint == output.pixels16)
+            accept16(output, packet);
+    }
+    portEXIT_CRITICAL(&_stageMux);
+}
+
+void ArtnetServer::accept8(Output &output, ArtnetChannelPacket<ArtnetEndpoint> *packet) {
+    _accept(output, output.stage, output.screen->input, packet);
+}
+
+void ArtnetServer::accept16(Output &output, ArtnetChannelPacket<ArtnetEndpoint> *packet) {
+    // acceptDMX allocated input16
+    _accept(output, output.stage16, output.screen->input16, packet);
+}
 
-    unsigned int offset = (unsigned int) packet->channelUniverse << (uint8_t) 9;
+template <typename Pixel>
+void ArtnetServer::_accept(Output &output, Stage &stage, TripleBuffer<Pixel> *input,
+                           ArtnetChannelPacket<ArtnetEndpoint> *packet) {
+    Screen *screen = output.screen;
+    int bufferSize = screen->bufferSize * sizeof(Pixel);
+
+    unsigned int universe = packet->channelUniverse;
+    unsigned int offset = universe << (uint8_t) 9;
     if (offset >= bufferSize) {
         return; // Out of scope
     }
-    uint16_t arrayCount = bufferSize - (int) offset;
-    uint8_t *array = buffer + offset;
 
-    memcpy(array, packet->data, std::min(arrayCount, packet->length));
+    auto now = micros();
+    uint8_t sequence = packet->sequence;
+
+    // Only a little behind counts; further back, the sender probably restarted
+    uint8_t presentedSequence = stage.presentedSequences[universe];
+    int8_t sequenceAge = int8_t(presentedSequence - sequence);
+    if (sequence != 0 && presentedSequence != 0 && sequenceAge >= 0 && sequenceAge < 16) {
+        // This universe is on screen with the same or a newer packet
+        if (!stage.isLateCounted) {
+            output.lateFrames++;
+            stage.isLateCounted = true;
+        }
+        return;
+    }
+
+    // Sequences may count per universe, so only a repeated universe
+    // tells for sure that the next frame started
+    if (stage.stagedCount > 0 && (stage.staged[universe] || _isStalled(stage, now))) {
+        // The next frame started, or this one stalled;
+        // the staged universes are all we're getting
+        _present(output, stage, input);
+    }
+
+    if (stage.stagedCount == 0)
+        stage.stageTimestamp = now;
+
+    // Presenting swaps the back buffer
+    uint8_t *array = reinterpret_cast<uint8_t *>(input->back()) + offset;
+    size_t arrayCount = std::min(size_t(bufferSize - (int) offset), size_t(packet->length));
+
+    if (sizeof(Pixel) == sizeof(PRGB16)) {
+        // DMX sends the coarse byte first, we're little endian.
+        // Universes are even-sized, so pairs never straddle two packets.
+        for (size_t i = 0; i < arrayCount; ++i)
+            array[i ^ 1] = packet->data[i];
+    }
+    else
+        memcpy(array, packet->data, arrayCount);
+
+    if (!stage.staged[universe]) {
+        stage.staged[universe] = true;
+        stage.stagedCount++;
+    }
+    stage.stagedSequences[universe] = sequence;
+
+    screen->lastInputTimestamp = now;
+    screen->hasInput = true;
+
+    if (stage.stagedCount == stage.universeCount && !isSynced())
+        _present(output, stage, input);
+}
+
+bool ArtnetServer::_isStalled(const Stage &stage, unsigned long now) {
+    return now - stage.stageTimestamp > ART_NET_FRAME_TIMEOUT_MICROS;
+}
+
+template <typename Pixel>
+void ArtnetServer::_present(Output &output, Stage &stage, TripleBuffer<Pixel> *input) {
+    if (stage.stagedCount < stage.universeCount) {
+        // Keep what's on screen where nothing new came in,
+        // rather than whatever older frame back() held
+        auto *buffer = reinterpret_cast<uint8_t *>(input->back());
+        auto *latest = reinterpret_cast<const uint8_t *>(input->latest());
+        size_t bufferSize = output.screen->bufferSize * sizeof(Pixel);
+
+        for (size_t universe = 0; universe < stage.universeCount; ++universe) {
+            if (stage.staged[universe])
+                continue;
+
+            size_t offset = universe << 9;
+            memcpy(buffer + offset, latest + offset, std::min(size_t(512), bufferSize - offset));
+        }
+
+        output.partialFrames++;
+    }
+    output.frames++;
+
+    input->publish();
+
+    for (size_t universe = 0; universe < stage.universeCount; ++universe) {
+        if (stage.staged[universe])
+            stage.presentedSequences[universe] = stage.stagedSequences[universe];
+    }
+    stage.isLateCounted = false;
+    std::fill(stage.staged.begin(), stage.staged.end(), false);
+    stage.stagedCount = 0;
 }
 
 void ArtnetServer::acceptSync(IPAddress *remoteIP) {
-    SerialLog.print("Got Sync: ");
-    SerialLog.print(*remoteIP).ln();
+    if (!isSynced()) {
+        SerialLog.print("Got Sync, presenting on sync from now on: ");
+        SerialLog.print(*remoteIP).ln();
+    }
+
+    portENTER_CRITICAL(&_stageMux);
+    lastSyncTimestamp = micros();
+    hasSync = true;
+
+    for (auto &output : outputs) {
+        if (output.stage.stagedCount > 0)
+            _present(output, output.stage, output.screen->input);
+        // Only ever staged into once input16 exists
+        if (output.stage16.stagedCount > 0)
+            _present(output, output.stage16, output.screen->input16);
+    }
+    portEXIT_CRITICAL(&_stageMux);
+}
+
+template <typename Pixel>
+void ArtnetServer::_update(Output &output, Stage &stage, TripleBuffer<Pixel> *input, unsigned long now, bool isSynced) {
+    if (stage.stagedCount == 0)
+        return;
+
+    // Stalled, e.g. the last frame before the sender went quiet lost
+    // a packet; or complete, but the sender stopped syncing
+    if (_isStalled(stage, now) || (stage.stagedCount == stage.universeCount && !isSynced))
+        _present(output, stage, input);
+}
+
+void ArtnetServer::update() {
+    portENTER_CRITICAL(&_stageMux);
+    auto now = micros();
+    bool isSynced = this->isSynced();
+
+    for (auto &output : outputs) {
+        _update(output, output.stage, output.screen->input, now, isSynced);
+        _update(output, output.stage16, output.screen->input16, now, isSynced);
+    }
+    portEXIT_CRITICAL(&_stageMux);
+}
+
+bool ArtnetServer::isSynced() {
+    return hasSync && micros() - lastSyncTimestamp < ART_SYNC_TIMEOUT_MICROS;
 }
 
 std::vector<ArtnetEndpoint *> *ArtnetServer::endpoints() {
@@ -6,22 +6,91 @@
 #define LED_FAN_ARTNETSERVER_H
 
 
+#include <freertos/FreeRTOS.h>
 #include <screen/Screen.h>
 #include "AsyncArtnet.h"
 #include "ArtnetEndpoint.h"
 
+#include <vector>
+
+// Screen i listens on nets 2i (8 bit) and 2i + 1 (16 bit).
+// Universes are staged per screen and width, and presented together,
+// on ArtSync if the sender uses it, or once all of them are in.
 class ArtnetServer {
 public:
+    struct Stage {
+        size_t universeCount;
+        // Universes staged for the next frame, in the input's back buffer
+        std::vector<bool> staged;
+        size_t stagedCount = 0;
+        unsigned long stageTimestamp = 0;
+        // Per universe, the ArtDmx sequence staged and last presented.
+        // Senders may count per universe, so a single one won't do.
+        // 0 if the sender doesn't number them.
+        std::vector<uint8_t> stagedSequences, presentedSequences;
+        bool isLateCounted = false;
+
+        explicit Stage(size_t universeCount)
+        : universeCount(universeCount), staged(universeCount, false),
+        stagedSequences(universeCount, 0), presentedSequences(universeCount, 0) {}
+    };
+
+    struct Output {
+        Screen *screen;
+        // 8 bit per component, or 16 bit (coarse byte first)
+        ArtnetEndpoint *pixels, *pixels16;
+
+        // Into screen->input and screen->input16
+        Stage stage, stage16;
+
+        // Frames presented
+        unsigned long frames = 0;
+        // Frames presented with universes missing
+        unsigned long partialFrames = 0;
+        // Frames with universes that only came in after they were presented
+        unsigned long lateFrames = 0;
+    };
+
     AsyncArtnet<ArtnetEndpoint> *artnet;
 
-    Screen *screen;
+    std::vector<Output> outputs;
 
-    ArtnetServer(Screen *screen);
+    // Time of the last ArtSync
+    unsigned long lastSyncTimestamp = 0;
+    bool hasSync = false;
+
+    explicit ArtnetServer(const std::vector<Screen *> &screens);
 
     void acceptDMX(ArtnetChannelPacket<ArtnetEndpoint> *);
+    void accept8(Output &output, ArtnetChannelPacket<ArtnetEndpoint> *);
+    void accept16(Output &output, ArtnetChannelPacket<ArtnetEndpoint> *);
     void acceptSync(IPAddress *remoteIP);
 
+    // Presents frames that stalled, even if no more packets come in.
+    // Call regularly, at least every ART_NET_FRAME_TIMEOUT_MICROS.
+    void update();
+
+    // True while the sender uses ArtSync
+    bool isSynced();
+
     std::vector<ArtnetEndpoint *> *endpoints();
+
+private:
+    // Staging is done from the network task and update().
+    // Frames are small, so neither spins long on the other,
+    // and reception never waits on a blocked task.
+    portMUX_TYPE _stageMux = portMUX_INITIALIZER_UNLOCKED;
+
+    // Stages the packet's universe into input's back buffer
+    template <typename Pixel>
+    void _accept(Output &output, Stage &stage, TripleBuffer<Pixel> *input, ArtnetChannelPacket<ArtnetEndpoint> *packet);
+    // Hands the staged universes to the screen
+    template <typename Pixel>
+    void _present(Output &output, Stage &stage, TripleBuffer<Pixel> *input);
+    // Presents the stage if it stalled, or if it's complete and not waiting for a sync
+    template <typename Pixel>
+    void _update(Output &output, Stage &stage, TripleBuffer<Pixel> *input, unsigned long now, bool isSynced);
+    bool _isStalled(const Stage &stage, unsigned long now);
 };
 
 
@@ -17,6 +17,7 @@
 
 #include <utility>
 #include <util/CrudeJson.h>
+#include <util/TextFiles.h>
 
 #define SERVE_HTML(uri, file) _server.on(uri, HTTP_GET, [template_processor](AsyncWebServerRequest *request){\
     request->send(SPIFFS, file, "text/html", false, template_processor);\
@@ -26,10 +27,8 @@
 
 using namespace std::placeholders;
 
-// FIXME This should be per-instance. Or something.
-AsyncWebServer _server(80);
-
-HttpServer::HttpServer(App *app) : app(app), videoInterface(new VideoInterface(app->screen, app->artnetServer)) {
+HttpServer::HttpServer(App *app, int port)
+: app(app), videoInterface(new VideoInterface(app->screen, app->artnetServer)), _server(port) {
     setupRoutes();
     _server.begin();
 }
@@ -62,10 +61,31 @@ String HttpServer::processTemplates(const String &var) {
         unsigned long meanMicrosPerFrame = app->regularClock->frameTimeHistory->mean();
 
         auto fpsString = String(1000 * 1000 / std::max(meanMicrosPerFrame, app->regularClock->microsecondsPerFrame))
-            + " (slack: " + String(_max(0, (int) (app->regularClock->microsecondsPerFrame - meanMicrosPerFrame))) + "µs)";
+            + " (slack: " + String(_max(0, (int) (app->regularClock->microsecondsPerFrame - meanMicrosPerFrame))) + "µs"
+            + ", skipped: " + String(app->screen->renderer->skippedFrames)
+            + ", partial: " + String(app->screen->renderer->partialFrames) + ")";
 
         return fpsString;
     }
+    if (var == "MEMORY") {
+        auto bytesPerPixel = app->screen->renderer->bytesPerPixel();
+        return String(bytesPerPixel) + " bytes per LED"
+            + " (free heap fits " + String(ESP.getFreeHeap() / bytesPerPixel) + " more)";
+    }
+    if (var == "RENDER_TIME") {
+        auto renderer = app->screen->renderer;
+        return String(int(renderer->renderTimeHistory->mean())) + "µs"
+            + " (peak: " + String(renderer->renderTimeHistory->max()) + "µs"
+            + ", waiting for output: " + String(int(renderer->transmitWaitHistory->mean())) + "µs"
+            + ", LUT rebuild: " + String(renderer->componentLUTFlushTime) + "µs"
+            + (app->screen->compositor
+                ? String(", composite: ") + String(int(app->screen->compositor->compositeTimeHistory->mean())) + "µs"
+                : String())
+            + (app->screen->capture->isCapturing()
+                ? String(", capture: ") + String(int(app->screen->capture->recordTimeHistory->mean())) + "µs"
+                : String())
+            + ")";
+    }
 
     return String("ERROR");
 }
@@ -87,29 +107,58 @@ bool handlePartialFile(AsyncWebServerRequest *request, uint8_t *data, size_t len
     return false;
 }
 
-void registerREST(const char* url, String param, const std::function<String(String)>& set, const std::function<String()>& get) {
-    _server.on(url, HTTP_POST, [param, set](AsyncWebServerRequest *request) {
-        if (!request->hasParam(param, true)) {
+// Screen from the optional 'screen' param, 0 by default; -1 if there's no such screen
+int screenIndex(AsyncWebServerRequest *request, App *app) {
+    int index = 0;
+    if (request->hasParam("screen", true))
+        index = request->getParam("screen", true)->value().toInt();
+    else if (request->hasParam("screen"))
+        index = request->getParam("screen")->value().toInt();
+
+    return index >= 0 && index < int(app->screens.size()) ? index : -1;
+}
+
+// Indexed by Compositor::BlendMode
+static const char *const blendModeNames[] = { "normal", "add", "multiply", "max" };
+
+// Integer param from the body; fallback if absent
+int intParam(AsyncWebServerRequest *request, const char *name, int fallback) {
+    return request->hasParam(name, true) ? int(request->getParam(name, true)->value().toInt()) : fallback;
+}
+
+void HttpServer::registerREST(const char* url, String param, const std::function<String(size_t, String)>& set, const std::function<String(size_t)>& get) {
+    auto app = this->app;
+
+    _server.on(url, HTTP_POST, [app, param, set](AsyncWebServerRequest *request) {
+        int screen = screenIndex(request, app);
+        if (screen < 0 || !request->hasParam(param, true)) {
             request_result(false);
         }
 
         auto value = request->getParam(param, true)->value();
-        auto result = set(value);
+        auto result = set(screen, value);
         if (result.isEmpty())
             request->send(400, "text/plain", "Failure");
         else
             request->send(200, "text/plain", result);
     });
 
-    _server.on(url, HTTP_GET, [get](AsyncWebServerRequest *request) {
-        request->send(200, "text/plain", get());
+    _server.on(url, HTTP_GET, [app, get](AsyncWebServerRequest *request) {
+        int screen = screenIndex(request, app);
+        if (screen < 0) {
+            request_result(false);
+        }
+
+        request->send(200, "text/plain", get(screen));
     });
 }
 
 void HttpServer::setupRoutes() {
     auto template_processor = std::bind(&HttpServer::processTemplates, this, _1);
     auto videoInterface = this->videoInterface;
-    auto screen = app->screen;
+    auto app = this->app;
+    auto renderTask = app->renderTask;
+    auto planner = app->planner;
     auto updater = app->updater;
 
     _server.serveStatic("/material.min.js", SPIFFS, "/material.min.js");
@@ -155,24 +204,30 @@ void HttpServer::setupRoutes() {
         request->send(404, "text/plain", "404 / Not Found");
     });
 
-    _server.on("/ping", HTTP_POST, [screen](AsyncWebServerRequest *request) {
+    _server.on("/ping", HTTP_POST, [app, renderTask](AsyncWebServerRequest *request) {
         unsigned long time = 2000 * 1000;
+        int screen = screenIndex(request, app);
+        if (screen < 0) {
+            request_result(false);
+        }
 
-        screen->behavior = new Ping(time);
+        renderTask->setBehavior(new Ping(time), screen);
         WifiLog.print("Pong").ln();
         request->send(200, "text/plain", String(time));
     });
 
-    registerREST("/behavior", "id", [screen](String id) {
+    registerREST("/behavior", "id", [renderTask](size_t screen, String id) {
         auto provider = NativeBehaviors::list[std::move(id)];
         if (provider == nullptr)
             return String();
 
-        screen->behavior = (*provider)();
+        if (!renderTask->setBehavior((*provider)(), screen))
+            return String();
         return String(2000 * 1000);
-    }, [screen](){
-        if (screen->behavior)
-            return screen->behavior->name();
+    }, [app](size_t screen) {
+        auto behavior = app->screens[screen]->behavior;
+        if (behavior)
+            return behavior->name();
         return String("None");
     });
 
@@ -193,15 +248,158 @@ void HttpServer::setupRoutes() {
         request->send(200, "text/plain", WifiLog.output.string());
     });
     
-    registerREST("/brightness", "brightness", [screen](String value) {
-        screen->setBrightness(value.toFloat());
-        return "Success";
-    }, [screen]() { return String(screen->getBrightness()); });
-
-    registerREST("/response", "response", [screen](String value) {
-        screen->setResponse(value.toFloat());
-        return "Success";
-    }, [screen]() { return String(screen->getResponse()); });
+    registerREST("/brightness", "brightness", [renderTask](size_t screen, String value) {
+        return renderTask->setBrightness(value.toFloat(), MICROS_BRIGHTNESS_FADE, screen) ? "Success" : "";
+    }, [app](size_t screen) { return String(app->screens[screen]->getBrightness()); });
+
+    // Raw r, g, b bytes per LED. Pick the screen in the query, since the body is data.
+    _server.on("/calibration", HTTP_POST, [app, renderTask](AsyncWebServerRequest *request) {
+        int screen = screenIndex(request, app);
+        if (screen < 0 || !request->_tempFile) {
+            request_result(false);
+        }
+
+        request->_tempFile.close();
+        // request_result evaluates its argument twice
+        bool success = renderTask->readCalibration(screen);
+        request_result(success);
+    }, nullptr, [app](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        int screen = screenIndex(request, app);
+        if (screen < 0 || total != app->screens[screen]->getPixelCount() * sizeof(PRGB))
+            return;
+
+        if (!index)
+            request->_tempFile = SPIFFS.open(String(CFG_PATH) + app->screens[screen]->confPath(CALIBRATION_CONF), FILE_WRITE);
+        request->_tempFile.write(data, len);
+    });
+
+    _server.on("/calibration", HTTP_DELETE, [app, renderTask](AsyncWebServerRequest *request) {
+        int screen = screenIndex(request, app);
+        if (screen < 0) {
+            request_result(false);
+        }
+
+        SPIFFS.remove(String(CFG_PATH) + app->screens[screen]->confPath(CALIBRATION_CONF));
+        bool success = renderTask->readCalibration(screen);
+        request_result(success);
+    });
+
+    registerREST("/response", "response", [renderTask](size_t screen, String value) {
+        return renderTask->setResponse(value.toFloat(), MICROS_BRIGHTNESS_FADE, screen) ? "Success" : "";
+    }, [app](size_t screen) { return String(app->screens[screen]->getResponse()); });
+
+    _server.on("/budget", HTTP_GET, [planner](AsyncWebServerRequest *request) {
+        auto budget = planner->budget;
+        request->send(200, "application/json", String("{")
+            + "\"transmit\":" + String(budget.transmit)
+            + ",\"cpu\":" + String(budget.cpu)
+            + ",\"pipelined\":" + (budget.pipelined ? "true" : "false")
+            + ",\"sustainable\":" + String(budget.sustainable)
+            + ",\"minimum\":" + String(budget.minimum)
+            + ",\"planned\":" + String(budget.planned)
+            + ",\"headroom\":" + String(planner->headroom)
+            + ",\"fps\":" + String(1000 * 1000 / std::max(budget.planned, 1UL))
+            + "}"
+        );
+    });
+
+    _server.on("/artnet", HTTP_GET, [app](AsyncWebServerRequest *request) {
+        auto artnetServer = app->artnetServer;
+        String json = String("{\"synced\":") + (artnetServer->isSynced() ? "true" : "false") + ",\"screens\":[";
+
+        for (size_t i = 0; i < artnetServer->outputs.size(); ++i) {
+            auto &output = artnetServer->outputs[i];
+            json += String(i > 0 ? "," : "")
+                + "{\"frames\":" + String(output.frames)
+                + ",\"partial\":" + String(output.partialFrames)
+                + ",\"late\":" + String(output.lateFrames) + "}";
+        }
+
+        request->send(200, "application/json", json + "]}");
+    });
+
+    _server.on("/capture", HTTP_POST, [app, renderTask](AsyncWebServerRequest *request) {
+        int screen = screenIndex(request, app);
+        bool success = screen >= 0 && renderTask->startCapture(screen);
+        request_result(success);
+    });
+
+    _server.on("/capture", HTTP_DELETE, [app, renderTask](AsyncWebServerRequest *request) {
+        int screen = screenIndex(request, app);
+        bool success = screen >= 0 && renderTask->stopCapture(screen);
+        request_result(success);
+    });
+
+    // See FrameCapture for the format. Capture pauses while downloading.
+    // The frame being recorded as the download starts may come out torn.
+    _server.on("/capture", HTTP_GET, [app](AsyncWebServerRequest *request) {
+        int screen = screenIndex(request, app);
+        if (screen < 0) {
+            request_result(false);
+        }
+
+        auto capture = app->screens[screen]->capture;
+        capture->beginRead();
+        request->onDisconnect([capture]() { capture->endRead(); });
+
+        auto response = request->beginChunkedResponse("application/octet-stream", [capture](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return capture->read(buffer, maxLen, index);
+        });
+        response->addHeader("Content-Disposition", "attachment; filename=capture.bin");
+        request->send(response);
+    });
+
+    // Overlays on top of whatever the screen shows, live input included.
+    // Takes the layer index, and optionally opacity (0 - 255),
+    // mode (see blendModeNames) and color (rrggbb, fills the layer).
+    // New layers stay hidden until given a color, and then
+    // default to fully opaque.
+    _server.on("/layer", HTTP_POST, [app, renderTask](AsyncWebServerRequest *request) {
+        int screen = screenIndex(request, app);
+        if (screen < 0 || !request->hasParam("layer", true)) {
+            request_result(false);
+        }
+
+        int mode = -1;
+        if (request->hasParam("mode", true)) {
+            auto name = request->getParam("mode", true)->value();
+            for (int i = 0; i <= Compositor::max; ++i) {
+                if (name == blendModeNames[i])
+                    mode = i;
+            }
+            if (mode < 0) {
+                request_result(false);
+            }
+        }
+
+        int32_t color = -1;
+        if (request->hasParam("color", true))
+            color = int32_t(strtol(request->getParam("color", true)->value().c_str(), nullptr, 16) & 0xffffff);
+
+        int index = intParam(request, "layer", -1);
+        int opacity = intParam(request, "opacity", -1);
+        bool success = index >= 0 && renderTask->setLayer(size_t(index), opacity, mode, color, screen);
+        request_result(success);
+    });
+
+    _server.on("/layer", HTTP_GET, [app](AsyncWebServerRequest *request) {
+        int screen = screenIndex(request, app);
+        if (screen < 0) {
+            request_result(false);
+        }
+
+        auto compositor = app->screens[screen]->compositor;
+        String json = "[";
+        for (size_t i = 0; compositor && i < Compositor::maxLayers; ++i) {
+            auto &layer = compositor->layers[i];
+            json += String(i > 0 ? "," : "")
+                + "{\"allocated\":" + (layer.pixels ? "true" : "false")
+                + ",\"opacity\":" + String(layer.opacity)
+                + ",\"mode\":\"" + blendModeNames[layer.mode] + "\"}";
+        }
+
+        request->send(200, "application/json", json + "]");
+    });
 
     // -----------------------------------------------
     // ------------------- Data ----------------------
@@ -22,10 +22,16 @@ public:
     App *app;
     VideoInterface *videoInterface;
 
-    HttpServer(App *app);
+    explicit HttpServer(App *app, int port = 80);
 
     void setupRoutes();
     String processTemplates(const String &var);
+
+private:
+    AsyncWebServer _server;
+
+    // POST sets param, GET returns the value, on the screen picked by the 'screen' param
+    void registerREST(const char* url, String param, const std::function<String(size_t, String)>& set, const std::function<String(size_t)>& get);
 };
 
 
@@ -0,0 +1,25 @@
+#include "Apa102Encoder.h"
+
+uint32_t Apa102Encoder::rescalers[32] = {0};
+uint32_t Apa102Encoder::reciprocals[32] = {0};
+uint32_t Apa102Encoder::brightnessStarts[33] = {0};
+
+void Apa102Encoder::initTables() {
+    if (rescalers[1] != 0)
+        return;
+
+    const uint32_t maxBrightness = 0b00011111;
+    const uint32_t _255e3 = 255 * 255 * 255;
+
+    for (uint32_t brightness = 1; brightness <= maxBrightness; ++brightness) {
+        rescalers[brightness] = _255e3 * brightness / maxBrightness;
+        reciprocals[brightness] = uint32_t((uint64_t(1) << 40) / rescalers[brightness]);
+
+        // Lowest peak where (peak - 1) / 255 * 31 / 255^3 reaches brightness - 1
+        uint32_t minPeakStep = ((brightness - 1) * _255e3 + maxBrightness - 1) / maxBrightness;
+        brightnessStarts[brightness] = minPeakStep * 255 + 1;
+    }
+
+    // Never reached
+    brightnessStarts[maxBrightness + 1] = UINT32_MAX;
+}
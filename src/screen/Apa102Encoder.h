@@ -0,0 +1,115 @@
+#ifndef LED_FAN_APA102ENCODER_H
+#define LED_FAN_APA102ENCODER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+struct Apa102Color {
+    uint8_t brightness;
+    uint8_t blue;
+    uint8_t green;
+    uint8_t red;
+};
+
+// Encodes 0 to 255^4 components into APA102 colors, using the
+// 5 bit global brightness for extra resolution. Division-free.
+// Shared by Apa102Renderer and StaticRenderer, so both encode alike.
+class Apa102Encoder {
+public:
+    // Per global brightness, the value of one output step
+    static uint32_t rescalers[32];
+    // Per global brightness, 2^40 / rescaler
+    static uint32_t reciprocals[32];
+    // Per global brightness, the lowest peak component that needs it
+    static uint32_t brightnessStarts[33];
+
+    // Call before encoding; does nothing if already done
+    static void initTables();
+
+    // Global brightness (1 to 31) for a peak component (1 to 255^4),
+    // equal to ((peak - 1) / 255 * 31 / 255^3) + 1.
+    static inline uint8_t globalBrightness(uint32_t peakBrightness) __attribute__((always_inline)) {
+        // 31 * 2^40 / 255^4; estimates at most one too low
+        const uint64_t factor = 8061;
+
+        uint32_t brightness = uint32_t(((peakBrightness - 1) * factor) >> 40) + 1;
+        if (peakBrightness >= brightnessStarts[brightness + 1])
+            ++brightness;
+
+        return uint8_t(brightness);
+    }
+
+    // value / rescaler, without dividing
+    static inline uint32_t divide(uint32_t value, uint32_t rescaler, uint32_t reciprocal) __attribute__((always_inline)) {
+        // The reciprocal is rounded down, so this is at most one too low
+        uint32_t quotient = uint32_t((uint64_t(value) * reciprocal) >> 40);
+        if (value - quotient * rescaler >= rescaler)
+            ++quotient;
+
+        return quotient;
+    }
+
+    // Encodes 0 to 255^4 components into 8 bit components
+    // and the 5 bit global brightness
+    static inline Apa102Color encode(uint32_t r_r, uint32_t g_r, uint32_t b_r) __attribute__((always_inline)) {
+        const uint8_t boundary = 0b11100000;
+
+        uint32_t peakBrightness = std::max(std::max(r_r, g_r), b_r);
+
+        if (peakBrightness == 0)
+            return Apa102Color { 0xff, 0, 0, 0 };
+
+        uint8_t brightness = globalBrightness(peakBrightness);
+
+        uint32_t rescaler = rescalers[brightness];
+        uint32_t reciprocal = reciprocals[brightness];
+
+        // We may have rounding errors coming out at 256
+        uint8_t r = std::min(divide(r_r, rescaler, reciprocal), uint32_t(255));
+        uint8_t g = std::min(divide(g_r, rescaler, reciprocal), uint32_t(255));
+        uint8_t b = std::min(divide(b_r, rescaler, reciprocal), uint32_t(255));
+
+        return Apa102Color {uint8_t(boundary | brightness), b, g, r };
+    }
+
+    static inline uint8_t ditherComponent(uint32_t value, uint32_t rescaler, uint32_t reciprocal, uint8_t *error) __attribute__((always_inline)) {
+        uint32_t component = divide(value, rescaler, reciprocal);
+        if (component >= 255)
+            return 255;
+
+        // Fraction of the next step we're losing, 0 to 255
+        uint32_t lost = uint32_t((uint64_t(value - component * rescaler) * reciprocal) >> 32);
+        uint32_t accumulated = *error + std::min(lost, uint32_t(255));
+
+        if (accumulated >= 256) {
+            *error = uint8_t(accumulated - 256);
+            return uint8_t(component + 1);
+        }
+
+        *error = uint8_t(accumulated);
+        return uint8_t(component);
+    }
+
+    static inline Apa102Color encodeDithered(uint32_t r_r, uint32_t g_r, uint32_t b_r, uint8_t *error) __attribute__((always_inline)) {
+        const uint8_t boundary = 0b11100000;
+
+        uint32_t peakBrightness = std::max(std::max(r_r, g_r), b_r);
+
+        if (peakBrightness == 0)
+            return Apa102Color { 0xff, 0, 0, 0 };
+
+        uint8_t brightness = globalBrightness(peakBrightness);
+
+        uint32_t rescaler = rescalers[brightness];
+        uint32_t reciprocal = reciprocals[brightness];
+
+        uint8_t r = ditherComponent(r_r, rescaler, reciprocal, error);
+        uint8_t g = ditherComponent(g_r, rescaler, reciprocal, error + 1);
+        uint8_t b = ditherComponent(b_r, rescaler, reciprocal, error + 2);
+
+        return Apa102Color {uint8_t(boundary | brightness), b, g, r };
+    }
+};
+
+#endif //LED_FAN_APA102ENCODER_H
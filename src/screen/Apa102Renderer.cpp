@@ -4,106 +4,210 @@
 
 #include "Apa102Renderer.h"
 #include <algorithm>
-#include <util/Logger.h>
+#include <esp32-hal.h>
 #include "Setup.h"
 
-Apa102Renderer::Apa102Renderer(size_t pixelCount, size_t overflowWall) : Renderer(pixelCount, overflowWall) {
-    _endBoundary = (pixelCount + overflowWall) / 32 * 4 + 1;
-    _startBoundary = 4;
-    bufferSize = (pixelCount + overflowWall) * 4 + _startBoundary + _endBoundary;
+Apa102Renderer::Apa102Renderer(size_t pixelCount, size_t overflowWall, size_t queueDepth)
+: Renderer(pixelCount, overflowWall), queueDepth(std::max(queueDepth, size_t(1))) {
+#if defined(LED_DATA_PIN_2) && defined(LED_CLOCK_PIN_2)
+    busCount = 2;
+#else
+    busCount = 1;
+#endif
+    buses = new Apa102Bus[busCount];
 
-    esp_err_t err;
+    // Each bus gets its own DMA channel, so they can run concurrently
+    _initBus(buses[0], HSPI_HOST, 2, LED_DATA_PIN, LED_CLOCK_PIN, 0, pixelCount / busCount);
+#if defined(LED_DATA_PIN_2) && defined(LED_CLOCK_PIN_2)
+    _initBus(buses[1], VSPI_HOST, 1, LED_DATA_PIN_2, LED_CLOCK_PIN_2, pixelCount / busCount, pixelCount);
+#endif
 
-    spi_bus_config_t buscfg = {};
-    buscfg.miso_io_num = -1;
-    buscfg.mosi_io_num = LED_DATA_PIN;
-    buscfg.sclk_io_num = LED_CLOCK_PIN;
-    buscfg.quadwp_io_num = -1;
-    buscfg.quadhd_io_num = -1;
-    buscfg.max_transfer_sz = bufferSize;
+    _staleStart = new size_t[this->queueDepth];
+    _staleEnd = new size_t[this->queueDepth];
+    for (size_t i = 0; i < this->queueDepth; ++i) {
+        _staleStart[i] = 0;
+        _staleEnd[i] = pixelCount;
+    }
 
-    spi_device_interface_config_t devcfg = {};
-    devcfg.clock_speed_hz = LED_CLOCK_SPEED_MHZ * 1000 * 1000;
-    devcfg.mode = 0; //SPI mode 0
-    devcfg.spics_io_num = -1; //CS pin
-    devcfg.queue_size = 1; //Not sure if needed
-    devcfg.command_bits = 0;
-    devcfg.address_bits = 0;
+    Apa102Encoder::initTables();
+}
 
-    SPI_settings.host = HSPI_HOST;
-    SPI_settings.dma_chan = 2;
-    SPI_settings.buscfg = buscfg;
-    SPI_settings.devcfg = devcfg;
+void Apa102Renderer::_initBus(Apa102Bus &bus, spi_host_device_t host, int dmaChannel, int dataPin, int clockPin,
+                              size_t pixelStart, size_t pixelEnd) {
+    // Each bus drives its own strip, so each gets the overflow wall
+    size_t busPixelCount = pixelEnd - pixelStart + overflowWall;
 
-    err = spi_bus_initialize(SPI_settings.host, &SPI_settings.buscfg, SPI_settings.dma_chan);
-    ESP_ERROR_CHECK(err);
+    bus.pixelStart = pixelStart;
+    bus.pixelEnd = pixelEnd;
+    bus.startBoundary = 4;
+    bus.endBoundary = busPixelCount / 32 * 4 + 1;
+    bus.bufferSize = busPixelCount * 4 + bus.startBoundary + bus.endBoundary;
 
-    //Attach the Accel to the SPI bus
-    err = spi_bus_add_device(SPI_settings.host, &SPI_settings.devcfg, &SPI_settings.spi);
-    ESP_ERROR_CHECK(err);
+    bus.queue = new SPIDMAQueue(
+        host, dmaChannel, dataPin, clockPin,
+        LED_CLOCK_SPEED_MHZ * 1000 * 1000,
+        bus.bufferSize, queueDepth
+    );
 
-    // Allocate DMA memory
-    buffer = reinterpret_cast<uint8_t *>(heap_caps_malloc(bufferSize, MALLOC_CAP_DMA));
-    if (!buffer) {
-        SerialLog.print("Failed to allocate SPI buffer; possibly too little DMA memory available?").ln();
-        exit(1);
+    for (size_t i = 0; i < bus.queue->queueDepth; ++i) {
+        _prepareBuffer(bus, bus.queue->buffers[i]);
     }
-    _prepareBuffer();
 }
 
-void Apa102Renderer::_prepareBuffer() {
-    // Prepare buffer - start and end boundary are
-    // actually all 0, so we might as well just fill the whole buffer
-    memset(buffer, 0, bufferSize);
+void Apa102Renderer::_prepareBuffer(Apa102Bus &bus, uint8_t *buffer) {
+    // Start and end boundary are all 0,
+    // which SPIDMAQueue already took care of.
+
+    // The overflow wall is never touched by the encoder,
+    // so it's best to black it out once
+    auto colorBuffer = reinterpret_cast<Apa102Color*>(buffer + bus.startBoundary);
+    for (size_t c = bus.pixelEnd - bus.pixelStart; c < bus.pixelEnd - bus.pixelStart + overflowWall; ++c) {
+        colorBuffer[c] = Apa102Encoder::encode(0, 0, 0);
+    }
 }
 
+void Apa102Renderer::_render() {
+    if (!_fusedKernel) {
+        Renderer::_render();
+        return;
+    }
 
-void Apa102Renderer::_flush() {
-    uint8_t boundary = 0b11100000;
-    Apa102Color emptyBoundary = Apa102Color {
-            0xff, 0, 0, 0
-    };
+    // Same as Renderer::_render() followed by _flush(), but without
+    // the intermediate _rgbOutput round trip.
+    _acquireBuffers();
+
+    if (_maxLightness <= 0) {
+        // Send each bus off as soon as it's ready, so the
+        // transmission overlaps with encoding the next bus.
+        uint32_t frameRescale = _frameRescale();
+
+        for (size_t b = 0; b < busCount; ++b) {
+            _encodeFused(buses[b], frameRescale, false);
+            buses[b].queue->transmit(buses[b].bufferSize);
+        }
+        return;
+    }
+
+    // Power limit is on; rescale by what the last frame needed.
+    // Only send once we know the frame isn't too bright.
+    uint64_t totalLightness = 0;
+    for (size_t b = 0; b < busCount; ++b) {
+        totalLightness += _encodeFused(buses[b], _frameRescale(), false);
+    }
+
+    if (_updateLightnessPrediction(totalLightness)) {
+        // Prediction was way off; too much power used, need to re-encode :(
+        for (size_t b = 0; b < busCount; ++b) {
+            _encodeFused(buses[b], _frameRescale(), true);
+        }
+    }
+
+    for (size_t b = 0; b < busCount; ++b) {
+        buses[b].queue->transmit(buses[b].bufferSize);
+    }
+}
+
+uint64_t Apa102Renderer::_encodeFused(Apa102Bus &bus, uint32_t lightnessRescale, bool isCorrection) {
+    return rgb16
+        ? _encodeFusedFrom<true>(bus, lightnessRescale, isCorrection)
+        : _encodeFusedFrom<false>(bus, lightnessRescale, isCorrection);
+}
 
-    uint8_t maxBrightness = 0b00011111;
-    int _255e3 = 255 * 255 * 255;
+template <bool wide>
+uint64_t Apa102Renderer::_encodeFusedFrom(Apa102Bus &bus, uint32_t lightnessRescale, bool isCorrection) {
+    auto colorBuffer = _colorBuffer(bus);
+    uint64_t totalLightness = 0;
+
+    size_t start = std::max(_encodeStart, bus.pixelStart);
+    size_t end = std::min(_encodeEnd, bus.pixelEnd);
+
+    if (lightnessRescale >= 255) {
+        for (size_t i = start * 3, c = start; c < end; i += 3, ++c) {
+            uint32_t r_r = _lookup<wide>(i) * _componentLUT[i];
+            uint32_t g_r = _lookup<wide>(i + 1) * _componentLUT[i + 1];
+            uint32_t b_r = _lookup<wide>(i + 2) * _componentLUT[i + 2];
+            totalLightness += uint64_t(r_r) + g_r + b_r;
+
+            _write(colorBuffer + (c - bus.pixelStart), c, r_r, g_r, b_r);
+        }
 
-    auto colorBuffer = reinterpret_cast<Apa102Color*>(buffer);
+        return totalLightness;
+    }
 
-    unsigned int i = 0, c = _startBoundary / 4;
-    while(i < (pixelCount + overflowWall) * 3) {
-        uint32_t r_r = _rgbOutput[0], g_r = _rgbOutput[1], b_r = _rgbOutput[2];
-        i+=3;
-        uint32_t peakBrightness = std::max(std::max(r_r, g_r), b_r);
+    if (isCorrection) {
+        // Dithering already advanced this frame, so leave it out.
+        for (size_t i = start * 3, c = start; c < end; i += 3, ++c) {
+            uint32_t r_r = _lookup<wide>(i) * _componentLUT[i] / 255 * lightnessRescale;
+            uint32_t g_r = _lookup<wide>(i + 1) * _componentLUT[i + 1] / 255 * lightnessRescale;
+            uint32_t b_r = _lookup<wide>(i + 2) * _componentLUT[i + 2] / 255 * lightnessRescale;
 
-        if (peakBrightness == 0) {
-            colorBuffer[c++] = emptyBoundary;
-            continue;
+            colorBuffer[c - bus.pixelStart] = Apa102Encoder::encode(r_r, g_r, b_r);
         }
 
-        uint8_t brightness = ((peakBrightness - 1) / 255 * maxBrightness / _255e3) + 1;
+        return 0;
+    }
+
+    for (size_t i = start * 3, c = start; c < end; i += 3, ++c) {
+        uint32_t r_r = _lookup<wide>(i) * _componentLUT[i];
+        uint32_t g_r = _lookup<wide>(i + 1) * _componentLUT[i + 1];
+        uint32_t b_r = _lookup<wide>(i + 2) * _componentLUT[i + 2];
+        totalLightness += uint64_t(r_r) + g_r + b_r;
+
+        _write(colorBuffer + (c - bus.pixelStart), c,
+               r_r / 255 * lightnessRescale, g_r / 255 * lightnessRescale, b_r / 255 * lightnessRescale);
+    }
+
+    return totalLightness;
+}
+
+void Apa102Renderer::_flush() {
+    _acquireBuffers();
+
+    for (size_t b = 0; b < busCount; ++b) {
+        _encodeOutput(buses[b]);
+        buses[b].queue->transmit(buses[b].bufferSize);
+    }
+}
 
-        uint32_t rescaler = _255e3 * brightness / maxBrightness;
+void Apa102Renderer::_encodeOutput(Apa102Bus &bus) {
+    auto colorBuffer = _colorBuffer(bus);
+
+    size_t start = std::max(_encodeStart, bus.pixelStart);
+    size_t end = std::min(_encodeEnd, bus.pixelEnd);
+
+    for (size_t i = start * 3, c = start; c < end; i += 3, ++c) {
+        _write(colorBuffer + (c - bus.pixelStart), c, _rgbOutput[i], _rgbOutput[i + 1], _rgbOutput[i + 2]);
+    }
+}
 
-        // We may have rounding errors coming out at 256
-        uint8_t r = std::min(r_r / rescaler, uint32_t(255));
-        uint8_t g = std::min(g_r / rescaler, uint32_t(255));
-        uint8_t b = std::min(b_r / rescaler, uint32_t(255));
+void Apa102Renderer::_acquireBuffers() {
+    // Frames are only partial while no error is left anywhere,
+    // so the pixels encoded next tell for all of them
+    _ditherResidue = 0;
 
-        colorBuffer[c++] = Apa102Color {uint8_t(boundary | brightness), b, g, r };
+    for (size_t b = 0; b < busCount; ++b) {
+        _transmitWait += buses[b].queue->acquire();
     }
 
-    // Flush transaction
+    // All buses cycle through their buffers in lockstep
+    size_t current = buses[0].queue->currentTransaction;
 
-    spi_transaction_t *transaction = transactions + currentTransaction;
-    memset(transaction, 0, sizeof(*transaction));
-    transaction->length = bufferSize * 8; //length is in bits
-    transaction->tx_buffer = buffer;
+    // Other buffers still show older frames, so they need to catch up later.
+    // If the power limit is on, the frame range is always complete anyway.
+    for (size_t i = 0; i < queueDepth; ++i) {
+        _staleStart[i] = std::min(_staleStart[i], _frameStart);
+        _staleEnd[i] = std::max(_staleEnd[i], _frameEnd);
+    }
 
-    auto err = spi_device_queue_trans(SPI_settings.spi, transaction, portMAX_DELAY);
-    ESP_ERROR_CHECK(err);
+    _encodeStart = _staleStart[current];
+    _encodeEnd = _staleEnd[current];
+    _staleStart[current] = pixelCount;
+    _staleEnd[current] = 0;
+}
 
-    // Cycle to the other transaction
-    currentTransaction = (currentTransaction + 1) % 2;
+bool Apa102Renderer::_isVolatile() {
+    // Dithering changes every frame, until there's nothing left to carry over
+    return _ditherError != nullptr && _ditherResidue != 0;
 }
 
 uint8_t Apa102Renderer::getMaxDynamicColorRescale() const {
@@ -113,3 +217,57 @@ uint8_t Apa102Renderer::getMaxDynamicColorRescale() const {
 void Apa102Renderer::setMaxDynamicColorRescale(uint8_t maxDynamicColorRescale) {
     _maxDynamicColorRescale = std::max(uint8_t(1), maxDynamicColorRescale);
 }
+
+bool Apa102Renderer::isFusedKernel() const {
+    return _fusedKernel;
+}
+
+void Apa102Renderer::setFusedKernel(bool fusedKernel) {
+    _fusedKernel = fusedKernel;
+    setDirty();
+}
+
+bool Apa102Renderer::isDithering() const {
+    return _ditherError != nullptr;
+}
+
+void Apa102Renderer::setDithering(bool dithering) {
+    if (dithering == isDithering())
+        return;
+
+    if (dithering) {
+        _ditherError = new uint8_t[pixelCount * 3]{0};
+    }
+    else {
+        delete[] _ditherError;
+        _ditherError = nullptr;
+    }
+    _ditherResidue = 0;
+}
+
+bool Apa102Renderer::_usesOutputBuffer() {
+    return !_fusedKernel;
+}
+
+size_t Apa102Renderer::bytesPerPixel() {
+    size_t bytes = Renderer::bytesPerPixel();
+
+    if (_ditherError)
+        bytes += 3;
+
+    // One Apa102Color per pixel in each DMA buffer
+    return bytes + sizeof(Apa102Color) * queueDepth;
+}
+
+unsigned long Apa102Renderer::transmitMicros() {
+    // Buses run in parallel
+    unsigned long micros = 0;
+    for (size_t b = 0; b < busCount; ++b)
+        micros = std::max(micros, buses[b].queue->transmitMicros(buses[b].bufferSize));
+
+    return micros;
+}
+
+bool Apa102Renderer::isPipelined() {
+    return queueDepth > 1;
+}
@@ -6,38 +6,100 @@
 #define LED_FAN_APA102RENDERER_H
 
 
-#include <SPITools.h>
+#include <util/spi/SPIDMAQueue.h>
+#include <algorithm>
 #include "Renderer.h"
+#include "Apa102Encoder.h"
 
-struct Apa102Color {
-    uint8_t brightness;
-    uint8_t blue;
-    uint8_t green;
-    uint8_t red;
+// One SPI bus, showing a consecutive range of pixels
+struct Apa102Bus {
+    SPIDMAQueue *queue;
+
+    size_t pixelStart, pixelEnd;
+    size_t startBoundary, endBoundary;
+    size_t bufferSize;
 };
 
 class Apa102Renderer : public Renderer {
 public:
-    size_t bufferSize;
-    uint8_t* buffer;
-
-    SPI_settings_t SPI_settings = {};
+    // Number of DMA buffers per bus; while some are on the wire, the next one is encoded.
+    size_t queueDepth;
 
-    spi_transaction_t transactions[2];
-    int currentTransaction = 0;
+    // With more than one bus, the pixels are split evenly between them
+    size_t busCount;
+    Apa102Bus *buses;
 
-    Apa102Renderer(size_t pixelCount, size_t overflowWall);
+    Apa102Renderer(size_t pixelCount, size_t overflowWall, size_t queueDepth = 2);
 
     uint8_t getMaxDynamicColorRescale() const;
     void setMaxDynamicColorRescale(uint8_t maxDynamicColorRescale);
+
+    // If set, rendering goes straight from rgb to the SPI buffer
+    // in a single pass, without touching _rgbOutput.
+    bool isFusedKernel() const;
+    void setFusedKernel(bool fusedKernel);
+
+    // If set, the remainders lost when encoding are carried over
+    // to following frames, for more effective color depth.
+    bool isDithering() const;
+    void setDithering(bool dithering);
+
+    size_t bytesPerPixel() override;
+    unsigned long transmitMicros() override;
+    bool isPipelined() override;
 private:
     uint32_t _maxDynamicColorRescale = 255;
+    bool _fusedKernel = false;
 
-    size_t _startBoundary;
-    size_t _endBoundary;
+    // Per buffer index, the pixels that changed since it was last encoded
+    size_t *_staleStart;
+    size_t *_staleEnd;
+    // Pixels to encode into the current buffers
+    size_t _encodeStart, _encodeEnd;
 
-    void _prepareBuffer();
+    // Accumulated error per component, in 1/256 of an output step.
+    // nullptr if dithering is off.
+    uint8_t *_ditherError = nullptr;
+    // Non-zero if any error was left after encoding the last frame.
+    // Without, there is nothing to carry over and frames may be skipped.
+    uint8_t _ditherResidue = 0;
+
+    void _initBus(Apa102Bus &bus, spi_host_device_t host, int dmaChannel, int dataPin, int clockPin,
+                  size_t pixelStart, size_t pixelEnd);
+    void _prepareBuffer(Apa102Bus &bus, uint8_t *buffer);
+    void _render() override;
     void _flush() override;
+    bool _isVolatile() override;
+    bool _usesOutputBuffer() override;
+
+    // Reclaims finished transactions and selects the next free buffers,
+    // waiting for the oldest transactions if need be.
+    // Also determines the pixels to encode for them.
+    void _acquireBuffers();
+
+    // Encodes the current frame's pixels of the bus from rgb, rescaled (of 255).
+    // Returns the total lightness before rescaling.
+    // Corrections re-encode a frame, so they don't dither or count lightness.
+    uint64_t _encodeFused(Apa102Bus &bus, uint32_t lightnessRescale, bool isCorrection);
+    template <bool wide>
+    uint64_t _encodeFusedFrom(Apa102Bus &bus, uint32_t lightnessRescale, bool isCorrection);
+    // Encodes the current frame's pixels of the bus from _rgbOutput
+    void _encodeOutput(Apa102Bus &bus);
+
+    static inline Apa102Color *_colorBuffer(Apa102Bus &bus) __attribute__((always_inline)) {
+        return reinterpret_cast<Apa102Color*>(bus.queue->buffer() + bus.startBoundary);
+    }
+
+    inline void _write(Apa102Color *color, size_t pixel, uint32_t r_r, uint32_t g_r, uint32_t b_r) __attribute__((always_inline)) {
+        if (!_ditherError) {
+            *color = Apa102Encoder::encode(r_r, g_r, b_r);
+            return;
+        }
+
+        uint8_t *error = _ditherError + pixel * 3;
+        *color = Apa102Encoder::encodeDithered(r_r, g_r, b_r, error);
+        _ditherResidue |= error[0] | error[1] | error[2];
+    }
 };
 
 
@@ -0,0 +1,52 @@
+#ifndef LED_FAN_CLOCKLESSSPIENCODER_H
+#define LED_FAN_CLOCKLESSSPIENCODER_H
+
+#include <cstdint>
+#include <cstddef>
+#include "ClocklessTiming.h"
+
+// Encodes bytes for clockless strips (e.g. WS2812, SK6812) into an SPI bitstream,
+// so they can be sent by DMA without the CPU timing anything.
+// The reset has to fit the same clock, hence resetBytes.
+class ClocklessSPIEncoder {
+public:
+    // 400ns per SPI bit
+    static const int clockSpeedHz = 2500000;
+    // Each data bit is sent as 3 SPI bits, MSB first:
+    // 100 for 0 (400ns high, 800ns low), 110 for 1 (800ns high, 400ns low)
+    static const size_t bitsPerBit = 3;
+    static const size_t bytesPerPixel = 3 * bitsPerBit;
+    // Low bytes after each frame, rounded up
+    static const size_t resetBytes = (ClocklessTiming::resetMicros * (clockSpeedHz / 1000) / 1000 + 7) / 8;
+
+    // The 24 bit SPI stream for each byte
+    uint32_t table[256];
+
+    ClocklessSPIEncoder() {
+        for (uint32_t value = 0; value < 256; ++value) {
+            uint32_t bits = 0;
+
+            for (int bit = 7; bit >= 0; --bit) {
+                bits = (bits << 3) | ((value >> bit) & 1 ? 0b110 : 0b100);
+            }
+
+            table[value] = bits;
+        }
+    }
+
+    inline void encode(uint8_t value, uint8_t *stream) const __attribute__((always_inline)) {
+        uint32_t bits = table[value];
+        stream[0] = uint8_t(bits >> 16);
+        stream[1] = uint8_t(bits >> 8);
+        stream[2] = uint8_t(bits);
+    }
+
+    // Components in rgb order; strips take them in grb
+    inline void encodePixel(uint8_t r, uint8_t g, uint8_t b, uint8_t *stream) const __attribute__((always_inline)) {
+        encode(g, stream);
+        encode(r, stream + bitsPerBit);
+        encode(b, stream + 2 * bitsPerBit);
+    }
+};
+
+#endif //LED_FAN_CLOCKLESSSPIENCODER_H
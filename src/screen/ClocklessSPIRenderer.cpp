@@ -0,0 +1,54 @@
+#include "ClocklessSPIRenderer.h"
+
+#include <algorithm>
+
+ClocklessSPIRenderer::ClocklessSPIRenderer(size_t pixelCount, size_t overflowWall, int dataPin, size_t queueDepth,
+                                           spi_host_device_t host, int dmaChannel)
+: Renderer(pixelCount, overflowWall) {
+    // Black and the reset bytes are 0 already; the overflow wall is
+    // encoded once, then never touched again.
+    size_t bufferSize = (pixelCount + overflowWall) * ClocklessSPIEncoder::bytesPerPixel
+        + ClocklessSPIEncoder::resetBytes;
+    queue = new SPIDMAQueue(host, dmaChannel, dataPin, -1, ClocklessSPIEncoder::clockSpeedHz, bufferSize, queueDepth);
+
+    for (size_t i = 0; i < queue->queueDepth; ++i) {
+        for (size_t p = pixelCount; p < pixelCount + overflowWall; ++p) {
+            encoder.encodePixel(0, 0, 0, queue->buffers[i] + p * ClocklessSPIEncoder::bytesPerPixel);
+        }
+    }
+}
+
+void ClocklessSPIRenderer::_flush() {
+    // Returns right away unless all buffers are still on the wire
+    _transmitWait += queue->acquire();
+
+    const uint32_t _255e3 = 255 * 255 * 255;
+    uint8_t *stream = queue->buffer();
+
+    // _rgbOutput is always complete, and the buffer may hold an older frame,
+    // so encode everything
+    for (size_t i = 0; i < pixelCount * 3; i += 3, stream += ClocklessSPIEncoder::bytesPerPixel) {
+        // We may have rounding errors coming out at 256
+        encoder.encodePixel(
+            uint8_t(std::min(_rgbOutput[i] / _255e3, uint32_t(255))),
+            uint8_t(std::min(_rgbOutput[i + 1] / _255e3, uint32_t(255))),
+            uint8_t(std::min(_rgbOutput[i + 2] / _255e3, uint32_t(255))),
+            stream
+        );
+    }
+
+    queue->transmit(queue->bufferSize);
+}
+
+size_t ClocklessSPIRenderer::bytesPerPixel() {
+    // Encoded frame per DMA buffer
+    return Renderer::bytesPerPixel() + ClocklessSPIEncoder::bytesPerPixel * queue->queueDepth;
+}
+
+unsigned long ClocklessSPIRenderer::transmitMicros() {
+    return queue->transmitMicros(queue->bufferSize);
+}
+
+bool ClocklessSPIRenderer::isPipelined() {
+    return queue->queueDepth > 1;
+}
@@ -0,0 +1,29 @@
+#ifndef LED_FAN_CLOCKLESSSPIRENDERER_H
+#define LED_FAN_CLOCKLESSSPIRENDERER_H
+
+
+#include <util/spi/SPIDMAQueue.h>
+#include "Renderer.h"
+#include "ClocklessSPIEncoder.h"
+
+// Drives one clockless strip (e.g. WS2812, GRB order) from the data pin
+// of an SPI bus. Frames are encoded into DMA buffers and sent in the background,
+// so rendering returns right away and interrupts stay on.
+class ClocklessSPIRenderer : public Renderer {
+public:
+    SPIDMAQueue *queue;
+    ClocklessSPIEncoder encoder;
+
+    // Each renderer needs its own bus and DMA channel
+    ClocklessSPIRenderer(size_t pixelCount, size_t overflowWall, int dataPin, size_t queueDepth = 2,
+                         spi_host_device_t host = HSPI_HOST, int dmaChannel = 2);
+
+    size_t bytesPerPixel() override;
+    unsigned long transmitMicros() override;
+    bool isPipelined() override;
+private:
+    void _flush() override;
+};
+
+
+#endif //LED_FAN_CLOCKLESSSPIRENDERER_H
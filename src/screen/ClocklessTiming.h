@@ -0,0 +1,12 @@
+#ifndef LED_FAN_CLOCKLESSTIMING_H
+#define LED_FAN_CLOCKLESSTIMING_H
+
+// Timing shared by all outputs for clockless strips (e.g. WS2812, SK6812)
+class ClocklessTiming {
+public:
+    // How long the line stays low after a frame, so the strip latches it.
+    // WS2812B need more than 280µs; older parts make do with less.
+    static const unsigned int resetMicros = 300;
+};
+
+#endif //LED_FAN_CLOCKLESSTIMING_H
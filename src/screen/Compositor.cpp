@@ -0,0 +1,130 @@
+#include "Compositor.h"
+
+#include <algorithm>
+#include <esp32-hal.h>
+
+Compositor::Compositor(size_t pixelCount)
+: pixelCount(pixelCount) {
+    output = new PRGB[pixelCount + 1]{PRGB::black};
+    compositeTimeHistory = new IntRoller(50);
+}
+
+Compositor::Layer *Compositor::layer(size_t index) {
+    Layer &layer = layers[index];
+
+    if (!layer.pixels) {
+        layer.pixels = new PRGB[pixelCount]{PRGB::black};
+        _setDirty(layer);
+    }
+
+    return &layer;
+}
+
+void Compositor::setOpacity(size_t index, uint8_t opacity) {
+    layers[index].opacity = opacity;
+    _setDirty(layers[index]);
+}
+
+void Compositor::setBlendMode(size_t index, BlendMode mode) {
+    layers[index].mode = mode;
+    _setDirty(layers[index]);
+}
+
+void Compositor::setBaseDirty(size_t start, size_t end) {
+    _baseDirtyStart = _baseDirtyStart < _baseDirtyEnd ? std::min(_baseDirtyStart, start) : start;
+    _baseDirtyEnd = std::max(_baseDirtyEnd, end);
+}
+
+PRGB16 *Compositor::getOutput16() {
+    if (!_output16) {
+        _output16 = new PRGB16[pixelCount + 1];
+        PRGB16(0, 0, 0).fill(_output16, int(pixelCount + 1));
+        // Nothing in it yet
+        setBaseDirty(0, pixelCount);
+    }
+
+    return _output16;
+}
+
+void Compositor::_setDirty(Layer &layer) {
+    layer.setDirty(0, pixelCount);
+}
+
+// Moves from by opacity (of 255) towards to
+static inline int _mix(int from, int to, int opacity) __attribute__((always_inline));
+static inline int _mix(int from, int to, int opacity) {
+    return from + (to - from) * opacity / 255;
+}
+
+void Compositor::composite(const PRGB *base, Renderer *renderer) {
+    _composite<uint8_t, 1>(reinterpret_cast<const uint8_t *>(base), reinterpret_cast<uint8_t *>(output), renderer);
+}
+
+void Compositor::composite(const PRGB16 *base, Renderer *renderer) {
+    _composite<uint16_t, 257>(reinterpret_cast<const uint16_t *>(base), reinterpret_cast<uint16_t *>(getOutput16()), renderer);
+}
+
+// Layers are 8 bit; scale brings them to the base's range
+template <typename Component, int scale>
+void Compositor::_composite(const Component *base, Component *output, Renderer *renderer) {
+    // Pixels touched in the base or any layer, even hidden ones,
+    // since hiding a layer changes what's below it too
+    size_t start = pixelCount, end = 0;
+    if (_baseDirtyStart < _baseDirtyEnd) {
+        start = _baseDirtyStart;
+        end = std::min(_baseDirtyEnd, pixelCount);
+    }
+    _baseDirtyStart = _baseDirtyEnd = 0;
+
+    for (auto &layer : layers) {
+        if (layer.dirtyStart < layer.dirtyEnd) {
+            start = std::min(start, layer.dirtyStart);
+            end = std::max(end, std::min(layer.dirtyEnd, pixelCount));
+        }
+        layer.dirtyStart = layer.dirtyEnd = 0;
+    }
+
+    if (start >= end)
+        return;
+
+    auto startTime = micros();
+
+    // Only visible layers take part; the rest are skipped entirely
+    const Layer *visible[maxLayers];
+    size_t visibleCount = 0;
+    for (auto &layer : layers) {
+        if (_isVisible(layer))
+            visible[visibleCount++] = &layer;
+    }
+
+    const int maxValue = 255 * scale;
+
+    for (size_t i = start * 3; i < end * 3; ++i) {
+        int value = base ? base[i] : 0;
+
+        for (size_t l = 0; l < visibleCount; ++l) {
+            const Layer &layer = *visible[l];
+            int top = reinterpret_cast<const uint8_t *>(layer.pixels)[i];
+
+            switch (layer.mode) {
+                case normal:
+                    value = _mix(value, top * scale, layer.opacity);
+                    break;
+                case add:
+                    value = std::min(value + top * scale * layer.opacity / 255, maxValue);
+                    break;
+                case multiply:
+                    value = _mix(value, value * top / 255, layer.opacity);
+                    break;
+                case max:
+                    value = _mix(value, std::max(value, top * scale), layer.opacity);
+                    break;
+            }
+        }
+
+        output[i] = Component(value);
+    }
+
+    renderer->setDirty(start, end);
+    compositeTimeHistory->push(int(micros() - startTime));
+}
@@ -0,0 +1,86 @@
+#ifndef LED_FAN_COMPOSITOR_H
+#define LED_FAN_COMPOSITOR_H
+
+
+#include <cstddef>
+#include <algorithm>
+#include <util/IntRoller.h>
+#include "Pixels.h"
+#include "Renderer.h"
+
+// Stacks a fixed number of layers on top of a base frame, bottom (0) first,
+// into its own output. The base is whatever the screen would show otherwise,
+// so layers overlay a behavior or live input alike.
+class Compositor {
+public:
+    enum BlendMode {
+        normal, add, multiply, max
+    };
+
+    struct Layer {
+        // Only allocated once the layer is requested
+        PRGB *pixels = nullptr;
+        // 0 hides the layer, 255 is fully opaque.
+        // New layers start hidden, so allocating one changes nothing.
+        uint8_t opacity = 0;
+        BlendMode mode = normal;
+
+        // Pixels changed since the last composite.
+        // Anyone writing to pixels must mark them.
+        size_t dirtyStart = 0, dirtyEnd = 0;
+
+        void setDirty(size_t start, size_t end) {
+            dirtyStart = dirtyStart < dirtyEnd ? std::min(dirtyStart, start) : start;
+            dirtyEnd = std::max(dirtyEnd, end);
+        }
+    };
+
+    static const size_t maxLayers = 4;
+
+    size_t pixelCount;
+    Layer layers[maxLayers];
+
+    // Result of the last composite(), with one more pixel, always black,
+    // for Topology to gather unmapped pixels from
+    PRGB *output;
+
+    // Microseconds spent in each of the last composite() calls that did something
+    IntRoller *compositeTimeHistory;
+
+    explicit Compositor(size_t pixelCount);
+
+    // Allocates the layer's pixels (black) if need be
+    Layer *layer(size_t index);
+
+    void setOpacity(size_t index, uint8_t opacity);
+    void setBlendMode(size_t index, BlendMode mode);
+
+    // Marks pixels [start, end) of the base as changed
+    void setBaseDirty(size_t start, size_t end);
+
+    // Blends all visible layers over base (nullptr for black) into output
+    // in one pass, over the pixels that changed in the base or any layer,
+    // and marks those dirty in the renderer. Does nothing if nothing changed.
+    void composite(const PRGB *base, Renderer *renderer);
+    // Same, for a 16 bit base, into getOutput16()
+    void composite(const PRGB16 *base, Renderer *renderer);
+
+    // Like output, for 16 bit bases; allocated on first use
+    PRGB16 *getOutput16();
+
+private:
+    size_t _baseDirtyStart = 0, _baseDirtyEnd = 0;
+    PRGB16 *_output16 = nullptr;
+
+    bool _isVisible(const Layer &layer) {
+        return layer.pixels && layer.opacity > 0;
+    }
+
+    void _setDirty(Layer &layer);
+
+    template <typename Component, int scale>
+    void _composite(const Component *base, Component *output, Renderer *renderer);
+};
+
+
+#endif //LED_FAN_COMPOSITOR_H
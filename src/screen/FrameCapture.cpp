@@ -0,0 +1,184 @@
+#include "FrameCapture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <Esp.h>
+#include <esp32-hal.h>
+
+FrameCapture::FrameCapture(size_t pixelCount)
+: pixelCount(pixelCount), _frameSize(sizeof(uint32_t) + pixelCount * sizeof(PRGB)) {
+    recordTimeHistory = new IntRoller(50);
+}
+
+bool FrameCapture::start(float maxHeapRatio, size_t minFreeHeap) {
+    portENTER_CRITICAL(&_readMux);
+    // Keep the ring, if a stop waited for it
+    _isStopPending = false;
+    portEXIT_CRITICAL(&_readMux);
+
+    if (isCapturing())
+        return true;
+
+    // Heap is fragmented, so ask for what the largest block allows
+    size_t available = std::min(
+        size_t(float(ESP.getFreeHeap()) * maxHeapRatio),
+        size_t(ESP.getMaxAllocHeap())
+    );
+    size_t frames = available / _frameSize;
+    if (frames == 0)
+        return false;
+
+    _ring = new (std::nothrow) uint8_t[frames * _frameSize];
+    if (!_ring)
+        return false;
+
+    capacity = frames;
+    _head = 0;
+    _minFreeHeap = minFreeHeap;
+    recordedFrames = 0;
+    pausedFrames = 0;
+    recordTimeHistory->fill(0);
+
+    return true;
+}
+
+bool FrameCapture::stop() {
+    portENTER_CRITICAL(&_readMux);
+    bool isReading = _readers > 0;
+    _isStopPending = isReading;
+    portEXIT_CRITICAL(&_readMux);
+
+    if (isReading)
+        return false;
+
+    _free();
+    return true;
+}
+
+void FrameCapture::update() {
+    // Racy peek; a pending stop we miss is picked up next frame
+    if (!_isStopPending)
+        return;
+
+    portENTER_CRITICAL(&_readMux);
+    bool isFree = _isStopPending && _readers == 0;
+    if (isFree)
+        _isStopPending = false;
+    portEXIT_CRITICAL(&_readMux);
+
+    if (isFree)
+        _free();
+}
+
+void FrameCapture::_free() {
+    // No reader can start in between: beginRead() sees either
+    // the ring, or none, under the lock
+    portENTER_CRITICAL(&_readMux);
+    uint8_t *ring = _ring;
+    _ring = nullptr;
+    capacity = 0;
+    portEXIT_CRITICAL(&_readMux);
+
+    delete[] ring;
+}
+
+void FrameCapture::record(const PRGB *rgb) {
+    auto start = micros();
+    uint8_t *pixels = _beginRecord(start);
+    if (!pixels)
+        return;
+
+    memcpy(pixels, rgb, pixelCount * sizeof(PRGB));
+    _endRecord(start);
+}
+
+void FrameCapture::record(const PRGB16 *rgb) {
+    auto start = micros();
+    uint8_t *pixels = _beginRecord(start);
+    if (!pixels)
+        return;
+
+    auto components = reinterpret_cast<const uint16_t *>(rgb);
+    for (size_t i = 0; i < pixelCount * 3; ++i)
+        pixels[i] = uint8_t(components[i] >> 8);
+    _endRecord(start);
+}
+
+uint8_t *FrameCapture::_beginRecord(unsigned long start) {
+    // A reader starting right after this may see this frame torn
+    if (_readers > 0)
+        return nullptr;
+
+    if (ESP.getFreeHeap() < _minFreeHeap) {
+        // Someone else needs the memory more; don't make things worse
+        pausedFrames++;
+        return nullptr;
+    }
+
+    uint8_t *frame = _ring + _head * _frameSize;
+    auto timestamp = uint32_t(start);
+    memcpy(frame, &timestamp, sizeof(timestamp));
+
+    return frame + sizeof(timestamp);
+}
+
+void FrameCapture::_endRecord(unsigned long start) {
+    _head = (_head + 1) % capacity;
+    recordedFrames++;
+
+    recordTimeHistory->push(int(micros() - start));
+}
+
+size_t FrameCapture::beginRead() {
+    portENTER_CRITICAL(&_readMux);
+    // Recording stops with the first reader, so later ones see the same
+    if (_readers++ == 0) {
+        _readFrameCount = isCapturing() ? std::min(size_t(recordedFrames), capacity) : 0;
+        // Oldest frame first; until the ring is full, that's slot 0
+        _readStart = _readFrameCount < capacity ? 0 : _head;
+
+        uint32_t fields[] = { uint32_t(pixelCount), uint32_t(_readFrameCount) };
+        memcpy(_header, "LLCF", 4);
+        _header[4] = version;
+        memset(_header + 5, 0, 3);
+        memcpy(_header + 8, fields, sizeof(fields));
+    }
+    size_t frameCount = _readFrameCount;
+    portEXIT_CRITICAL(&_readMux);
+
+    return headerSize + frameCount * _frameSize;
+}
+
+void FrameCapture::endRead() {
+    portENTER_CRITICAL(&_readMux);
+    _readers--;
+    portEXIT_CRITICAL(&_readMux);
+}
+
+size_t FrameCapture::read(uint8_t *buffer, size_t maxLength, size_t index) {
+    size_t fileSize = headerSize + _readFrameCount * _frameSize;
+    size_t length = std::min(maxLength, fileSize - std::min(index, fileSize));
+    size_t written = 0;
+
+    while (written < length) {
+        size_t position = index + written;
+        size_t chunk;
+
+        if (position < headerSize) {
+            chunk = std::min(length - written, headerSize - position);
+            memcpy(buffer + written, _header + position, chunk);
+        }
+        else {
+            size_t frame = (position - headerSize) / _frameSize;
+            size_t offset = (position - headerSize) - frame * _frameSize;
+            size_t slot = (_readStart + frame) % capacity;
+
+            chunk = std::min(length - written, _frameSize - offset);
+            memcpy(buffer + written, _ring + slot * _frameSize + offset, chunk);
+        }
+
+        written += chunk;
+    }
+
+    return written;
+}
@@ -0,0 +1,87 @@
+#ifndef LED_FAN_FRAMECAPTURE_H
+#define LED_FAN_FRAMECAPTURE_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <freertos/FreeRTOS.h>
+#include <util/IntRoller.h>
+#include "Pixels.h"
+
+// Records the last frames sent to the renderer into a ring, for debugging.
+// Costs nothing but memory while capturing, and nothing at all otherwise.
+// Recording and stopping happen on the render task; any number of
+// other tasks may download at once, and the ring outlives them all.
+// File format, little endian:
+// "LLCF", version (1 byte), 3 bytes padding, pixel count (4 bytes), frame count (4 bytes),
+// then per frame, oldest first: micros() timestamp (4 bytes), r, g, b per pixel.
+class FrameCapture {
+public:
+    static const uint8_t version = 1;
+    static const size_t headerSize = 16;
+
+    size_t pixelCount;
+    // Frames the ring holds; 0 while not capturing
+    size_t capacity = 0;
+
+    // Frames recorded since start, including overwritten ones
+    unsigned long recordedFrames = 0;
+    // Frames not recorded because free heap ran low
+    unsigned long pausedFrames = 0;
+    // Microseconds spent in each of the last record() calls
+    IntRoller *recordTimeHistory;
+
+    explicit FrameCapture(size_t pixelCount);
+
+    bool isCapturing() const {
+        return _ring != nullptr;
+    }
+
+    // Sizes the ring to take at most maxHeapRatio of free heap.
+    // While capturing, frames are skipped if free heap drops below minFreeHeap.
+    // Returns false if not even one frame fits.
+    bool start(float maxHeapRatio, size_t minFreeHeap);
+    // While downloads are going on, the ring is only freed once
+    // the last one ends, by update(); returns false then.
+    bool stop();
+    // Frees the ring of a stop that waited for downloads. Render task only.
+    void update();
+
+    void record(const PRGB *rgb);
+    // Records the coarse byte of each component
+    void record(const PRGB16 *rgb);
+
+    // Freezes the ring for reading; recording pauses until
+    // every reader called endRead(). Returns the file size.
+    size_t beginRead();
+    void endRead();
+    // Copies up to maxLength bytes of the file, starting at index.
+    // Only between beginRead() and endRead().
+    size_t read(uint8_t *buffer, size_t maxLength, size_t index);
+
+private:
+    uint8_t *_ring = nullptr;
+    size_t _frameSize;
+    // Next slot to write
+    size_t _head = 0;
+    size_t _minFreeHeap = 0;
+
+    // Downloads between beginRead() and endRead(). While any are,
+    // the ring stays put. Guarded by _readMux, as is _isStopPending.
+    int _readers = 0;
+    bool _isStopPending = false;
+    portMUX_TYPE _readMux = portMUX_INITIALIZER_UNLOCKED;
+
+    // Same for all readers, since the ring is frozen while any read
+    size_t _readFrameCount = 0;
+    size_t _readStart = 0;
+    uint8_t _header[headerSize];
+
+    // Returns where the next frame's pixels go, or nullptr to skip it
+    uint8_t *_beginRecord(unsigned long start);
+    void _endRecord(unsigned long start);
+    void _free();
+};
+
+
+#endif //LED_FAN_FRAMECAPTURE_H
@@ -0,0 +1,62 @@
+#include "FramePlanner.h"
+
+#include <algorithm>
+#include <utility>
+#include <util/Logger.h>
+
+FramePlanner::FramePlanner(std::vector<Renderer *> renderers, RegularClock *clock, unsigned long minMicrosPerFrame, float headroom)
+: renderers(std::move(renderers)), clock(clock), minMicrosPerFrame(minMicrosPerFrame), headroom(headroom) {
+    cpuTimeHistory = new IntRoller(50);
+
+    // Until we know better, go by the wire alone
+    _plan();
+    replan();
+}
+
+void FramePlanner::replan() {
+    _framesUntilPlan = int(cpuTimeHistory->count);
+}
+
+void FramePlanner::update(unsigned long frameMicros) {
+    if (_framesUntilPlan <= 0)
+        return;
+
+    // Time spent waiting on the output is bounded by transmit already
+    unsigned long transmitWait = 0;
+    for (auto renderer : renderers)
+        transmitWait += renderer->lastTransmitWait();
+    cpuTimeHistory->push(int(frameMicros - std::min(frameMicros, transmitWait)));
+
+    if (--_framesUntilPlan == 0)
+        _plan();
+}
+
+void FramePlanner::_plan() {
+    budget.transmit = 0;
+    budget.pipelined = true;
+    for (auto renderer : renderers) {
+        budget.transmit = std::max(budget.transmit, renderer->transmitMicros());
+        budget.pipelined = budget.pipelined && renderer->isPipelined();
+    }
+
+    // Skipped frames make for a low mean, while a single frame with
+    // one-off work (first frame of a behavior, LUT rebuild) makes for
+    // a high peak. Plan for what nearly all frames take.
+    budget.cpu = (unsigned long) std::max(0, cpuTimeHistory->percentile(FRAME_PLAN_CPU_PERCENTILE));
+
+    budget.sustainable = budget.pipelined
+        ? std::max(budget.transmit, budget.cpu)
+        : budget.transmit + budget.cpu;
+    budget.minimum = minMicrosPerFrame;
+    budget.planned = std::max(
+        (unsigned long) (float(budget.sustainable) * headroom),
+        budget.minimum
+    );
+
+    if (budget.planned == clock->microsecondsPerFrame)
+        return;
+
+    clock->microsecondsPerFrame = budget.planned;
+    SerialLog.print("Planned frame time: ").print(budget.planned).print("µs (on the wire: ")
+        .print(budget.transmit).print("µs, CPU: ").print(budget.cpu).print("µs)").ln();
+}
@@ -0,0 +1,67 @@
+#ifndef LED_FAN_FRAMEPLANNER_H
+#define LED_FAN_FRAMEPLANNER_H
+
+
+#include <vector>
+#include <util/IntRoller.h>
+#include <util/RegularClock.h>
+#include "Renderer.h"
+
+// Ratio of frames the planned CPU time covers
+static const float FRAME_PLAN_CPU_PERCENTILE = 0.9f;
+
+// Sets the clock's frame time to what the output can sustain,
+// from the time a frame takes on the wire and the measured
+// CPU time per frame, rather than letting the clock fall behind.
+// With several outputs, their transfers run in parallel.
+// Plans once after boot and after each replan(); stays put in between.
+class FramePlanner {
+public:
+    // All in microseconds per frame
+    struct Budget {
+        // Sending one frame, from buffer size and clock speed; 0 if unknown.
+        // The slowest output, with several.
+        unsigned long transmit;
+        // Behavior, composite and encode, without waiting for the output
+        unsigned long cpu;
+        // All outputs run in parallel with the CPU
+        bool pipelined;
+        // The physical maximum, from the above
+        unsigned long sustainable;
+        // From MAX_FRAMES_PER_SECOND
+        unsigned long minimum;
+        // sustainable with headroom, or minimum; what the clock runs at
+        unsigned long planned;
+    };
+
+    std::vector<Renderer *> renderers;
+    RegularClock *clock;
+
+    unsigned long minMicrosPerFrame;
+    // Planned frame time is this much above the sustainable one,
+    // so jitter doesn't throw the clock off
+    float headroom;
+
+    Budget budget = {};
+
+    // CPU microseconds of the last frames
+    IntRoller *cpuTimeHistory;
+
+    FramePlanner(std::vector<Renderer *> renderers, RegularClock *clock, unsigned long minMicrosPerFrame, float headroom);
+
+    // Measures anew and plans once enough frames are in.
+    // Call after anything that may change the cost of a frame.
+    void replan();
+
+    // Call once per frame, with the time the screens took to update;
+    // not counting the clock's delay or command handling.
+    void update(unsigned long frameMicros);
+
+private:
+    int _framesUntilPlan;
+
+    void _plan();
+};
+
+
+#endif //LED_FAN_FRAMEPLANNER_H
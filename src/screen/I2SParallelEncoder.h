@@ -0,0 +1,38 @@
+#ifndef LED_FAN_I2SPARALLELENCODER_H
+#define LED_FAN_I2SPARALLELENCODER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <util/BitTranspose.h>
+
+// Encodes up to 8 clockless (e.g. WS2812) strips into one stream
+// of 16 bit I2S samples, where bit j of each sample drives strip j.
+// I2SParallelRenderer owns the I2S setup and DMA chain; this only fills samples.
+class I2SParallelEncoder {
+public:
+    // Each color bit is sent as high, data, low
+    static const size_t slotsPerBit = 3;
+    static const size_t slotsPerPixel = 3 * 8 * slotsPerBit;
+
+    // componentLanes: For each of the 3 components in wire order,
+    // one byte per lane (8 lanes, unused lanes 0).
+    // laneMask: Bit j set if lane j is in use.
+    // In 16 bit mode, I2S sends the halves of each 32 bit word swapped,
+    // so slots are written pairwise swapped as well.
+    static inline void encodePixel(const uint8_t *componentLanes, uint16_t laneMask, uint16_t *slots) __attribute__((always_inline)) {
+        uint8_t bits[8];
+        size_t s = 0;
+
+        for (size_t c = 0; c < 3; ++c) {
+            BitTranspose::transpose8(componentLanes + c * 8, bits);
+
+            for (size_t k = 0; k < 8; ++k) {
+                slots[(s++) ^ 1] = laneMask;
+                slots[(s++) ^ 1] = bits[k];
+                slots[(s++) ^ 1] = 0;
+            }
+        }
+    }
+};
+
+#endif //LED_FAN_I2SPARALLELENCODER_H
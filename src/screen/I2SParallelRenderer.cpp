@@ -0,0 +1,199 @@
+#include "I2SParallelRenderer.h"
+
+#include <algorithm>
+#include <esp32-hal.h>
+#include <esp_heap_caps.h>
+#include <driver/periph_ctrl.h>
+#include <soc/i2s_struct.h>
+#include <soc/gpio_sig_map.h>
+#include <rom/gpio.h>
+#include <util/Logger.h>
+#include "ClocklessTiming.h"
+
+// Low slots after each frame, at 2.4MHz
+#define I2S_PARALLEL_RESET_SLOTS (ClocklessTiming::resetMicros * 24 / 10)
+#define I2S_PARALLEL_DESCRIPTOR_BYTES 4092
+
+I2SParallelRenderer::I2SParallelRenderer(size_t pixelCount, size_t overflowWall, const int *pins, size_t laneCount)
+: Renderer(pixelCount, overflowWall), laneCount(std::min(laneCount, maxLanes)) {
+    std::copy(pins, pins + this->laneCount, this->pins);
+
+    lanePixelCount = (pixelCount + this->laneCount - 1) / this->laneCount + overflowWall;
+    bufferSize = (lanePixelCount * I2SParallelEncoder::slotsPerPixel + I2S_PARALLEL_RESET_SLOTS) * sizeof(uint16_t);
+    _descriptorCount = (bufferSize + I2S_PARALLEL_DESCRIPTOR_BYTES - 1) / I2S_PARALLEL_DESCRIPTOR_BYTES;
+
+    for (int b = 0; b < 2; ++b) {
+        buffers[b] = reinterpret_cast<uint16_t *>(heap_caps_malloc(bufferSize, MALLOC_CAP_DMA));
+        _descriptors[b] = reinterpret_cast<lldesc_t *>(heap_caps_malloc(_descriptorCount * sizeof(lldesc_t), MALLOC_CAP_DMA));
+
+        if (!buffers[b] || !_descriptors[b]) {
+            SerialLog.print("Failed to allocate I2S buffer; possibly too little DMA memory available?").ln();
+            exit(1);
+        }
+
+        // Reset slots are all 0
+        memset(buffers[b], 0, bufferSize);
+
+        // The overflow wall never changes, so encode it once. Black still
+        // has to be sent as bits, or the wall LEDs keep their colors.
+        uint8_t black[3 * maxLanes] = {0};
+        for (size_t p = lanePixelCount - overflowWall; p < lanePixelCount; ++p)
+            I2SParallelEncoder::encodePixel(black, _laneMask(), buffers[b] + p * I2SParallelEncoder::slotsPerPixel);
+
+        auto bytes = reinterpret_cast<uint8_t *>(buffers[b]);
+        for (size_t d = 0; d < _descriptorCount; ++d) {
+            size_t offset = d * I2S_PARALLEL_DESCRIPTOR_BYTES;
+            size_t length = std::min(bufferSize - offset, size_t(I2S_PARALLEL_DESCRIPTOR_BYTES));
+
+            lldesc_t &descriptor = _descriptors[b][d];
+            descriptor.size = length;
+            descriptor.length = length;
+            descriptor.offset = 0;
+            descriptor.sosf = 0;
+            descriptor.owner = 1;
+            descriptor.buf = bytes + offset;
+            descriptor.eof = d == _descriptorCount - 1;
+            descriptor.qe.stqe_next = descriptor.eof ? nullptr : &_descriptors[b][d + 1];
+        }
+    }
+
+    _idle = xSemaphoreCreateBinary();
+    xSemaphoreGive(_idle);
+
+    _initPeripheral();
+}
+
+void I2SParallelRenderer::_initPeripheral() {
+    periph_module_enable(PERIPH_I2S0_MODULE);
+
+    // Reset everything
+    I2S0.conf.tx_reset = 1;
+    I2S0.conf.tx_reset = 0;
+    I2S0.conf.tx_fifo_reset = 1;
+    I2S0.conf.tx_fifo_reset = 0;
+    I2S0.lc_conf.out_rst = 1;
+    I2S0.lc_conf.out_rst = 0;
+    I2S0.lc_conf.ahbm_rst = 1;
+    I2S0.lc_conf.ahbm_rst = 0;
+
+    // Parallel output, 16 bits per sample
+    I2S0.conf2.val = 0;
+    I2S0.conf2.lcd_en = 1;
+
+    I2S0.sample_rate_conf.val = 0;
+    I2S0.sample_rate_conf.tx_bits_mod = 16;
+    I2S0.sample_rate_conf.tx_bck_div_num = 1;
+
+    // 80MHz / (33 + 1/3) = 2.4MHz; 3 slots per bit makes 800kHz
+    I2S0.clkm_conf.val = 0;
+    I2S0.clkm_conf.clka_en = 0;
+    I2S0.clkm_conf.clkm_div_num = 33;
+    I2S0.clkm_conf.clkm_div_b = 1;
+    I2S0.clkm_conf.clkm_div_a = 3;
+
+    I2S0.fifo_conf.val = 0;
+    I2S0.fifo_conf.tx_fifo_mod_force_en = 1;
+    I2S0.fifo_conf.tx_fifo_mod = 1; // 16 bit, single channel
+    I2S0.fifo_conf.tx_data_num = 32;
+    I2S0.fifo_conf.dscr_en = 1;
+
+    I2S0.conf1.val = 0;
+    I2S0.conf1.tx_pcm_bypass = 1;
+    I2S0.conf1.tx_stop_en = 1;
+
+    I2S0.conf_chan.val = 0;
+    I2S0.conf_chan.tx_chan_mod = 1;
+
+    I2S0.timing.val = 0;
+
+    I2S0.lc_conf.val = 0;
+    I2S0.lc_conf.out_eof_mode = 1;
+
+    // In 16 bit LCD mode, sample bits appear on DATA_OUT8 to DATA_OUT23
+    for (size_t lane = 0; lane < laneCount; ++lane) {
+        gpio_matrix_out(pins[lane], I2S0O_DATA_OUT8_IDX + lane, false, false);
+    }
+
+    I2S0.int_ena.val = 0;
+    I2S0.int_clr.val = I2S0.int_raw.val;
+    I2S0.int_ena.out_total_eof = 1;
+
+    auto err = esp_intr_alloc(ETS_I2S0_INTR_SOURCE, ESP_INTR_FLAG_IRAM | ESP_INTR_FLAG_LEVEL3,
+                              &I2SParallelRenderer::_interruptHandler, this, &_interruptHandle);
+    ESP_ERROR_CHECK(err);
+}
+
+void I2SParallelRenderer::_flush() {
+    // The other buffer may still be on the wire; this one is free
+    uint16_t *buffer = buffers[currentBuffer];
+    uint16_t laneMask = _laneMask();
+    // The overflow wall after them is already encoded
+    size_t lanePixels = lanePixelCount - overflowWall;
+    const uint32_t _255e3 = 255 * 255 * 255;
+
+    // Per component (wire order GRB), one byte per lane
+    uint8_t componentLanes[3 * maxLanes] = {0};
+
+    for (size_t p = 0; p < lanePixels; ++p) {
+        for (size_t lane = 0; lane < laneCount; ++lane) {
+            size_t pixel = lane * lanePixels + p;
+
+            if (pixel >= pixelCount) {
+                componentLanes[lane] = componentLanes[maxLanes + lane] = componentLanes[2 * maxLanes + lane] = 0;
+                continue;
+            }
+
+            // Since we round, some components may just barely reach 256
+            const uint32_t *output = _rgbOutput + pixel * 3;
+            componentLanes[lane] = std::min(output[1] / _255e3, uint32_t(255));
+            componentLanes[maxLanes + lane] = std::min(output[0] / _255e3, uint32_t(255));
+            componentLanes[2 * maxLanes + lane] = std::min(output[2] / _255e3, uint32_t(255));
+        }
+
+        I2SParallelEncoder::encodePixel(componentLanes, laneMask, buffer + p * I2SParallelEncoder::slotsPerPixel);
+    }
+
+    // Wait for the last frame to finish, letting other tasks run meanwhile
+    auto start = micros();
+    xSemaphoreTake(_idle, portMAX_DELAY);
+    _transmitWait += micros() - start;
+
+    _startTransmission(currentBuffer);
+    currentBuffer = 1 - currentBuffer;
+}
+
+void I2SParallelRenderer::_startTransmission(int buffer) {
+    I2S0.conf.tx_start = 0;
+    I2S0.conf.tx_reset = 1;
+    I2S0.conf.tx_reset = 0;
+    I2S0.conf.tx_fifo_reset = 1;
+    I2S0.conf.tx_fifo_reset = 0;
+    I2S0.lc_conf.out_rst = 1;
+    I2S0.lc_conf.out_rst = 0;
+
+    I2S0.out_link.addr = uint32_t(_descriptors[buffer]);
+    I2S0.out_link.start = 1;
+    I2S0.conf.tx_start = 1;
+}
+
+void IRAM_ATTR I2SParallelRenderer::_interruptHandler(void *arg) {
+    auto renderer = static_cast<I2SParallelRenderer *>(arg);
+
+    BaseType_t isHigherPriorityTaskWoken = pdFALSE;
+
+    if (I2S0.int_st.out_total_eof) {
+        // Trailing reset slots still drain from the FIFO; that's fine.
+        I2S0.out_link.stop = 1;
+        xSemaphoreGiveFromISR(renderer->_idle, &isHigherPriorityTaskWoken);
+    }
+
+    I2S0.int_clr.val = I2S0.int_st.val;
+
+    if (isHigherPriorityTaskWoken)
+        portYIELD_FROM_ISR();
+}
+
+unsigned long I2SParallelRenderer::transmitMicros() {
+    // One 16 bit sample per slot, at 2.4MHz
+    return (unsigned long) (uint64_t(bufferSize / sizeof(uint16_t)) * 10 / 24);
+}
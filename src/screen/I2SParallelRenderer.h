@@ -0,0 +1,55 @@
+#ifndef LED_FAN_I2SPARALLELRENDERER_H
+#define LED_FAN_I2SPARALLELRENDERER_H
+
+#include <rom/lldesc.h>
+#include <esp_intr_alloc.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "Renderer.h"
+#include "I2SParallelEncoder.h"
+
+// Drives up to 8 clockless strips (e.g. WS2812, GRB order) at once,
+// using I2S0 in parallel (LCD) mode. The pixels are split evenly
+// across the strips, so all of them refresh in the time of one.
+class I2SParallelRenderer : public Renderer {
+public:
+    static const size_t maxLanes = 8;
+
+    size_t laneCount;
+    int pins[maxLanes];
+    // Pixels per lane, including the overflow wall
+    size_t lanePixelCount;
+
+    // Two sample buffers; one is encoded while the other one is sent
+    size_t bufferSize;
+    uint16_t *buffers[2];
+    int currentBuffer = 0;
+
+    I2SParallelRenderer(size_t pixelCount, size_t overflowWall, const int *pins, size_t laneCount);
+
+    unsigned long transmitMicros() override;
+    bool isPipelined() override { return true; }
+
+private:
+    // DMA descriptors per buffer; each may hold up to 4092 bytes
+    size_t _descriptorCount;
+    lldesc_t *_descriptors[2];
+
+    intr_handle_t _interruptHandle;
+    // Given while no frame is on the wire; taken to send one,
+    // and given back by the interrupt once it's out
+    SemaphoreHandle_t _idle;
+
+    uint16_t _laneMask() const {
+        return uint16_t((1 << laneCount) - 1);
+    }
+
+    void _initPeripheral();
+    void _flush() override;
+    void _startTransmission(int buffer);
+
+    static void _interruptHandler(void *arg);
+};
+
+
+#endif //LED_FAN_I2SPARALLELRENDERER_H
@@ -2,30 +2,61 @@
 // Created by Lukas Tenbrink on 10.07.20.
 //
 
-#include <cmath>
 #include "Pixels.h"
 
+// Per hue sector, which of (v, p, q, t) go to r, g and b.
+// Sector 6 is only reached from hue 255 on, which wraps around to red
+// and continues like sector 0.
+static const uint8_t hsvSectorComponents[7][3] = {
+    {0, 3, 1},
+    {2, 0, 1},
+    {1, 0, 3},
+    {1, 2, 0},
+    {3, 1, 0},
+    {0, 1, 2},
+    {0, 3, 1},
+};
+
+// Integer only; each component is off by at most 1 from exact math.
+// h is 8.8 fixed point; whole hues give the same as 8 bit math would.
+static inline void hsvToRGB(uint32_t h, uint32_t s, uint32_t v, PRGB *rgb) __attribute__((always_inline));
+static inline void hsvToRGB(uint32_t h, uint32_t s, uint32_t v, PRGB *rgb) {
+    const uint32_t sectorSize = 255 * 256;
+
+    // 0 to 6 * sectorSize; the fraction within the sector is of sectorSize.
+    // All products below stay within 32 bits.
+    uint32_t hue = h * 6;
+    uint32_t sector = hue / sectorSize;
+    uint32_t fraction = hue - sector * sectorSize;
+
+    uint32_t vs = v * s;
+    const uint8_t components[4] = {
+        uint8_t(v),
+        uint8_t((v * 255 - vs) / 255),
+        uint8_t((v * (255 * sectorSize) - vs * fraction) / (255 * sectorSize)),
+        uint8_t((v * (255 * sectorSize) - vs * (sectorSize - fraction)) / (255 * sectorSize)),
+    };
+
+    const uint8_t *indices = hsvSectorComponents[sector];
+    rgb->r = components[indices[0]];
+    rgb->g = components[indices[1]];
+    rgb->b = components[indices[2]];
+}
+
 void PHSV::toRGB(PRGB *rgb) const {
-    double H = h / 255.0 * 6.0, S = s / 255.0, V = v / 255.0;
-
-    double fract = H - floor(H);
-
-    double P = V * (1. - S) * 255.0;
-    double Q = V * (1. - S * fract) * 255.0;
-    double T = V * (1. - S * (1. - fract)) * 255.0;
-
-    if (0. <= H && H < 1.)
-        *rgb = PRGB(V, T, P);
-    else if (1. <= H && H < 2.)
-        *rgb = PRGB(Q, V, P);
-    else if (2. <= H && H < 3.)
-        *rgb = PRGB(P, V, T);
-    else if (3. <= H && H < 4.)
-        *rgb = PRGB(P, Q, V);
-    else if (4. <= H && H < 5.)
-        *rgb = PRGB(T, P, V);
-    else if (5. <= H && H < 6.)
-        *rgb = PRGB(V, P, P);
-    else
-        *rgb = PRGB::black;
+    hsvToRGB(uint32_t(h) << 8, s, v, rgb);
+}
+
+void PHSV::toRGB(const PHSV *hsv, PRGB *rgb, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        hsvToRGB(uint32_t(hsv[i].h) << 8, hsv[i].s, hsv[i].v, rgb + i);
+    }
+}
+
+void PHSV::fillHueRamp(PRGB *rgb, size_t count, uint16_t startHue, uint16_t hueStep, uint8_t s, uint8_t v) {
+    uint16_t hue = startHue;
+
+    for (size_t i = 0; i < count; ++i, hue += hueStep) {
+        hsvToRGB(hue, s, v, rgb + i);
+    }
 }
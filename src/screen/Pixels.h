@@ -6,6 +6,7 @@
 #define LED_FAN_PIXELS_H
 
 #include <cstdint>
+#include <cstddef>
 
 struct PRGB;
 
@@ -25,6 +26,12 @@ struct PHSV {
     : h(ih), s(is), v(iv) {}
 
     void toRGB(PRGB *rgb) const;
+
+    static void toRGB(const PHSV *hsv, PRGB *rgb, size_t count);
+
+    // Fills rgb with hues starting at startHue, advancing by hueStep per pixel.
+    // Hues are 8.8 fixed point, so ramps over long strips stay smooth.
+    static void fillHueRamp(PRGB *rgb, size_t count, uint16_t startHue, uint16_t hueStep, uint8_t s, uint8_t v);
 };
 
 struct PRGB {
@@ -85,4 +92,38 @@ struct PRGB {
     } HTMLColorCode;
 };
 
+// 16 bit per component; 257 * PRGB's values
+struct PRGB16 {
+    union {
+        struct {
+            uint16_t r, g, b;
+        };
+        uint16_t components[3];
+    };
+
+    inline PRGB16() __attribute__((always_inline))
+    {
+    }
+
+    inline PRGB16( uint16_t ir, uint16_t ig, uint16_t ib)  __attribute__((always_inline))
+            : r(ir), g(ig), b(ib)
+    {
+    }
+
+    inline PRGB16(const PRGB16& rhs) __attribute__((always_inline)) = default;
+
+    inline PRGB16(const PRGB& rhs) __attribute__((always_inline))
+            : r(rhs.r * 257), g(rhs.g * 257), b(rhs.b * 257)
+    {
+    }
+
+    inline PRGB16& operator= (const PRGB16& rhs) __attribute__((always_inline)) = default;
+
+    void fill(PRGB16 *array, int count) {
+        for (int i = 0; i < count; ++i) {
+            array[i] = *this;
+        }
+    }
+};
+
 #endif //LED_FAN_PIXELS_H
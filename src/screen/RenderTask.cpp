@@ -0,0 +1,176 @@
+#include "RenderTask.h"
+
+#include <util/Logger.h>
+#include <algorithm>
+#include <utility>
+
+void runRenderTask(void *pvParameters) {
+    auto *task = static_cast<RenderTask *>(pvParameters);
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wmissing-noreturn"
+    for (;;) {
+        task->run();
+    }
+#pragma clang diagnostic pop
+}
+
+RenderTask::RenderTask(std::vector<Screen *> screens, RegularClock *regularClock, FramePlanner *planner, int mailboxSize)
+: screens(std::move(screens)), regularClock(regularClock), planner(planner) {
+    _mailbox = xQueueCreate(mailboxSize, sizeof(Command));
+
+    // Start the longest transfer first, so it's done by the time the others are
+    _schedule = this->screens;
+    std::stable_sort(_schedule.begin(), _schedule.end(), [](Screen *a, Screen *b) {
+        return a->renderer->transmitMicros() > b->renderer->transmitMicros();
+    });
+}
+
+void RenderTask::start(int core, int priority, int stackSize) {
+    auto result = xTaskCreatePinnedToCore(runRenderTask, "render", stackSize, this, priority, &handle, core);
+
+    if (result != pdPASS) {
+        SerialLog.print("Failed to start render task!").ln();
+        exit(1);
+    }
+}
+
+void RenderTask::run() {
+    auto delayMicros = regularClock->sync();
+
+    // Commands do one-off work, like reading from flash;
+    // that's not what a frame costs
+    _handleCommands();
+
+    auto start = micros();
+    for (auto screen : _schedule)
+        screen->update(delayMicros);
+
+    planner->update(micros() - start);
+}
+
+void RenderTask::_handleCommands() {
+    Command command;
+
+    while (xQueueReceive(_mailbox, &command, 0) == pdTRUE) {
+        Screen *screen = screens[command.screen];
+
+        switch (command.type) {
+            case Command::setBehavior:
+                screen->setBehavior(command.behavior);
+                planner->replan();
+                break;
+            case Command::setBrightness:
+                screen->setBrightness(command.value, command.fadeMicros);
+                break;
+            case Command::setResponse:
+                screen->setResponse(command.value, command.fadeMicros);
+                break;
+            case Command::readCalibration:
+                screen->readCalibration();
+                planner->replan();
+                break;
+            case Command::startCapture:
+                screen->startCapture();
+                planner->replan();
+                break;
+            case Command::stopCapture:
+                if (!screen->stopCapture())
+                    SerialLog.print("Capture is being downloaded, stopping once that's done.").ln();
+                planner->replan();
+                break;
+            case Command::setLayer: {
+                auto compositor = screen->useCompositor();
+                auto &layer = command.layer;
+                bool isNew = !compositor->layers[layer.index].pixels;
+                auto target = compositor->layer(layer.index);
+
+                if (layer.color >= 0) {
+                    PRGB(uint32_t(layer.color)).fill(target->pixels, int(compositor->pixelCount));
+                    target->setDirty(0, compositor->pixelCount);
+                }
+                if (layer.opacity >= 0)
+                    compositor->setOpacity(layer.index, uint8_t(layer.opacity));
+                else if (isNew && layer.color >= 0)
+                    // Shows once there's something in it
+                    compositor->setOpacity(layer.index, 255);
+                if (layer.mode >= 0)
+                    compositor->setBlendMode(layer.index, Compositor::BlendMode(layer.mode));
+                // Compositing costs time each frame
+                planner->replan();
+                break;
+            }
+        }
+    }
+}
+
+bool RenderTask::send(const Command &command) {
+    if (command.screen >= screens.size())
+        return false;
+
+    if (xQueueSend(_mailbox, &command, 0) != pdTRUE) {
+        SerialLog.print("Render task mailbox is full, dropping command.").ln();
+        return false;
+    }
+
+    return true;
+}
+
+bool RenderTask::setBehavior(NativeBehavior *behavior, size_t screen) {
+    Command command = {Command::setBehavior};
+    command.screen = screen;
+    command.behavior = behavior;
+
+    if (!send(command)) {
+        delete behavior;
+        return false;
+    }
+    return true;
+}
+
+bool RenderTask::setBrightness(float brightness, unsigned long fadeMicros, size_t screen) {
+    Command command = {Command::setBrightness};
+    command.screen = screen;
+    command.value = brightness;
+    command.fadeMicros = fadeMicros;
+    return send(command);
+}
+
+bool RenderTask::setResponse(float response, unsigned long fadeMicros, size_t screen) {
+    Command command = {Command::setResponse};
+    command.screen = screen;
+    command.value = response;
+    command.fadeMicros = fadeMicros;
+    return send(command);
+}
+
+bool RenderTask::readCalibration(size_t screen) {
+    Command command = {Command::readCalibration};
+    command.screen = screen;
+    return send(command);
+}
+
+bool RenderTask::startCapture(size_t screen) {
+    Command command = {Command::startCapture};
+    command.screen = screen;
+    return send(command);
+}
+
+bool RenderTask::stopCapture(size_t screen) {
+    Command command = {Command::stopCapture};
+    command.screen = screen;
+    return send(command);
+}
+
+bool RenderTask::setLayer(size_t index, int opacity, int mode, int32_t color, size_t screen) {
+    if (index >= Compositor::maxLayers || opacity > 255 || mode > Compositor::max)
+        return false;
+
+    Command command = {Command::setLayer};
+    command.screen = screen;
+    command.layer.index = uint8_t(index);
+    command.layer.opacity = int16_t(opacity);
+    command.layer.mode = int8_t(mode);
+    command.layer.color = color;
+    return send(command);
+}
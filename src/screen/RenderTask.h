@@ -0,0 +1,86 @@
+#ifndef LED_FAN_RENDERTASK_H
+#define LED_FAN_RENDERTASK_H
+
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+#include <vector>
+
+#include <util/RegularClock.h>
+#include "Screen.h"
+#include "FramePlanner.h"
+
+// Runs the frame loop of all screens on its own FreeRTOS task.
+// Other tasks must not touch the screens directly; they
+// post commands through the mailbox instead.
+// Each frame, screens are drawn one after the other, the one with the
+// longest transfer first. Since all outputs send in the background,
+// transfers overlap with drawing the next screen.
+class RenderTask {
+public:
+    struct Command {
+        enum Type {
+            setBehavior, setBrightness, setResponse, readCalibration,
+            startCapture, stopCapture, setLayer
+        } type;
+
+        union {
+            NativeBehavior *behavior;
+            float value;
+            // Negative values leave the layer's setting as is
+            struct {
+                uint8_t index;
+                int16_t opacity;
+                // Compositor::BlendMode
+                int8_t mode;
+                // 0xrrggbb, filling the layer
+                int32_t color;
+            } layer;
+        };
+
+        // For brightness and response, time to fade over
+        unsigned long fadeMicros;
+
+        // Index into screens
+        size_t screen;
+    };
+
+    std::vector<Screen *> screens;
+    RegularClock *regularClock;
+    FramePlanner *planner;
+
+    TaskHandle_t handle = nullptr;
+
+    RenderTask(std::vector<Screen *> screens, RegularClock *regularClock, FramePlanner *planner, int mailboxSize = 10);
+
+    void start(int core, int priority, int stackSize);
+
+    // Runs a single frame. Called repeatedly by the task.
+    void run();
+
+    // Thread safe; applied before the next frame.
+    // Commands for screens that don't exist are dropped.
+    bool send(const Command &command);
+    // Takes ownership of behavior, also if it fails
+    bool setBehavior(NativeBehavior *behavior, size_t screen = 0);
+    bool setBrightness(float brightness, unsigned long fadeMicros = 0, size_t screen = 0);
+    bool setResponse(float response, unsigned long fadeMicros = 0, size_t screen = 0);
+    bool readCalibration(size_t screen = 0);
+    bool startCapture(size_t screen = 0);
+    bool stopCapture(size_t screen = 0);
+    // Creates the screen's compositor if need be.
+    // Negative values leave that setting of the layer as is.
+    bool setLayer(size_t index, int opacity = -1, int mode = -1, int32_t color = -1, size_t screen = 0);
+
+private:
+    QueueHandle_t _mailbox;
+    // Screens in the order they are drawn
+    std::vector<Screen *> _schedule;
+
+    void _handleCommands();
+};
+
+
+#endif //LED_FAN_RENDERTASK_H
@@ -4,82 +4,261 @@
 
 #include <algorithm>
 #include <cmath>
+#include <esp32-hal.h>
 #include "Renderer.h"
 
 Renderer::Renderer(size_t pixelCount, size_t overflowWall)
 : pixelCount(pixelCount), overflowWall(overflowWall) {
     rgb = new PRGB[pixelCount]{PRGB::black};
-    _rgbOutput = new uint32_t [(pixelCount + overflowWall) * 3]{0};
-    _localBrightness = new float[pixelCount]{1};
+    _localBrightness = new uint8_t[pixelCount];
+    memset(_localBrightness, 255, pixelCount);
+    _localBrightnessStart = pixelCount;
+    _localBrightnessEnd = 0;
 
     _brightnessLUT = new uint32_t[256];
-    _componentLUT = new uint32_t[pixelCount * 3];
+    _componentLUT = new uint8_t[pixelCount * 3];
+
+    renderTimeHistory = new IntRoller(50);
+    transmitWaitHistory = new IntRoller(50);
+
+    _flushBrightnessLUT();
+    _flushComponentLUT();
 }
 
-void Renderer::_flushLUT() {
+void Renderer::_fillBrightnessLUT(uint32_t *lut, float brightness, float response) {
     for (int c = 0; c < 256; ++c) {
-        float desiredValue = powf(float(c), _response) * powf(255.0f, 3 - _response);
-        desiredValue *= _brightness;
+        float desiredValue = powf(float(c), response) * powf(255.0f, 3 - response);
+        desiredValue *= brightness;
 
         // If this is > 255^3, we will get overflows later.
         // Theoretically, someone can set some value > 100
         // And thus upscale the whole picture. We need to cap off.
-        _brightnessLUT[c] = std::min(
+        lut[c] = std::min(
             uint32_t(desiredValue),
             uint32_t(255 * 255 * 255)
         );
     }
+}
 
-    for (int i = 0; i < pixelCount * 3; ++i) {
-        int pIndex = i / 3;
-        float desiredValue = _localBrightness[pIndex] * _colorCorrection.components[i % 3];
-        _componentLUT[i] = std::min(
-            uint32_t(desiredValue),
-            uint32_t(255)
-        );
+void Renderer::_flushBrightnessLUT() {
+    setDirty();
+    _fillBrightnessLUT(_brightnessLUT, _brightness, _response);
+}
+
+void Renderer::_flushComponentLUT() {
+    _flushComponentLUT(0, pixelCount);
+}
+
+void Renderer::_flushComponentLUT(size_t start, size_t end) {
+    setDirty(start, end);
+    auto startTime = micros();
+
+    for (size_t p = start, i = start * 3; p < end; ++p) {
+        uint32_t localBrightness = _localBrightness[p];
+        PRGB calibration = _calibration ? _calibration[p] : PRGB(PRGB::white);
+
+        for (int c = 0; c < 3; ++c, ++i) {
+            // All factors are 0 to 255, so this is too
+            _componentLUT[i] = uint8_t(
+                localBrightness * _colorCorrection.components[c] * calibration.components[c] / (255 * 255)
+            );
+        }
     }
+
+    componentLUTFlushTime = micros() - startTime;
 }
 
-void Renderer::render() {
-    uint64_t totalLightness = 0;
+bool Renderer::is16Bit() const {
+    return rgb16 != nullptr;
+}
+
+void Renderer::setDirty(size_t start, size_t end) {
+    _dirtyStart = std::min(_dirtyStart, start);
+    _dirtyEnd = std::max(_dirtyEnd, std::min(end, pixelCount));
+}
+
+void Renderer::setDirty() {
+    _dirtyStart = 0;
+    _dirtyEnd = pixelCount;
+}
+
+bool Renderer::render() {
+    _transmitWait = 0;
+    _updateFade();
+    _updateLocalBrightness();
+
+    _frameStart = _dirtyStart;
+    _frameEnd = _dirtyEnd;
+    _dirtyStart = pixelCount;
+    _dirtyEnd = 0;
 
-    auto *rgbComponents = reinterpret_cast<uint8_t *>(rgb);
-    for (int i = 0; i < pixelCount * 3; ++i) {
-        // 0 to 255^4
-        uint32_t color = _brightnessLUT[rgbComponents[i]] * _componentLUT[i];
-        _rgbOutput[i] = color;
-        totalLightness += color;
+    bool isVolatile = _isVolatile();
+    if (_frameStart >= _frameEnd && !isVolatile) {
+        // Same as last frame, the output still shows it
+        skippedFrames++;
+        return false;
     }
 
-    if (_maxLightness > 0) {
-        float lightnessRatio = _maxLightness / (float(totalLightness) / (255.0f * 255.0f * 255.0f * 255.0f));
-        auto lightnessRescale = uint32_t(lroundf(lightnessRatio * 255));
+    if (isVolatile || _maxLightness > 0) {
+        // The power limit needs to know the whole frame
+        _frameStart = 0;
+        _frameEnd = pixelCount;
+    }
+    else if (_frameStart > 0 || _frameEnd < pixelCount)
+        partialFrames++;
 
-        if (lightnessRescale < 255) {
-            // Too much power used, need to rescale :(
-            for (int i = 0; i < pixelCount * 3; ++i) {
-                _rgbOutput[i] = _rgbOutput[i] / 255 * lightnessRescale;
-            }
-        }
+    auto start = micros();
+    _render();
+    renderTimeHistory->push(int(micros() - start - _transmitWait));
+    transmitWaitHistory->push(int(_transmitWait));
+
+    return true;
+}
+
+uint32_t Renderer::_lightnessRescale(uint64_t totalLightness) {
+    float lightness = float(totalLightness) / (255.0f * 255.0f * 255.0f * 255.0f);
+    if (lightness <= _maxLightness)
+        return 255;
+
+    float lightnessRatio = _maxLightness / lightness;
+    return uint32_t(lroundf(lightnessRatio * 255));
+}
+
+uint32_t Renderer::_frameRescale() {
+    if (_maxLightness <= 0)
+        return 255;
+
+    return _lightnessPrediction;
+}
+
+bool Renderer::_updateLightnessPrediction(uint64_t totalLightness) {
+    uint32_t lightnessRescale = _lightnessRescale(totalLightness);
+    // Sharp jump up; we can't let that through, even for one frame
+    bool needsCorrection = lightnessRescale + _lightnessTolerance < _lightnessPrediction;
+    uint32_t previousPrediction = _lightnessPrediction;
+
+    if (lightnessRescale <= _lightnessPrediction || _maxLightnessRamp == 0)
+        _lightnessPrediction = lightnessRescale;
+    else
+        // Brighten up slowly, against pumping
+        _lightnessPrediction = std::min(lightnessRescale, _lightnessPrediction + _maxLightnessRamp);
+
+    // This frame went out with the old prediction (unless corrected),
+    // and a ramp isn't done yet; either way, the next frame differs
+    // even if the input doesn't, so it can't be skipped.
+    if ((_lightnessPrediction != previousPrediction && !needsCorrection)
+        || _lightnessPrediction != lightnessRescale)
+        setDirty();
+
+    return needsCorrection;
+}
+
+void Renderer::_render() {
+    if (!_rgbOutput) {
+        _rgbOutput = new uint32_t [(pixelCount + overflowWall) * 3]{0};
+        // Previous frames never made it here
+        _frameStart = 0;
+        _frameEnd = pixelCount;
     }
 
+    if (rgb16)
+        _renderOutput<true>();
+    else
+        _renderOutput<false>();
+
     _flush();
 }
 
-float *Renderer::getLocalBrightness() {
+template <bool wide>
+void Renderer::_renderOutput() {
+    uint64_t totalLightness = 0;
+    uint32_t frameRescale = _frameRescale();
+
+    if (frameRescale >= 255) {
+        for (size_t i = _frameStart * 3; i < _frameEnd * 3; ++i) {
+            // 0 to 255^4
+            uint32_t color = _lookup<wide>(i) * _componentLUT[i];
+            _rgbOutput[i] = color;
+            totalLightness += color;
+        }
+    }
+    else {
+        // Power limit is on; rescale by what the last frame needed
+        for (size_t i = _frameStart * 3; i < _frameEnd * 3; ++i) {
+            uint32_t color = _lookup<wide>(i) * _componentLUT[i];
+            _rgbOutput[i] = color / 255 * frameRescale;
+            totalLightness += color;
+        }
+    }
+
+    if (_maxLightness > 0 && _updateLightnessPrediction(totalLightness)) {
+        // Prediction was way off; too much power used, need to rescale :(
+        frameRescale = _frameRescale();
+
+        for (size_t i = 0; i < pixelCount * 3; ++i) {
+            uint32_t color = _lookup<wide>(i) * _componentLUT[i];
+            _rgbOutput[i] = color / 255 * frameRescale;
+        }
+    }
+}
+
+uint8_t *Renderer::getLocalBrightness() {
     return _localBrightness;
 }
 
 void Renderer::setLocalBrightness(float *brightness) {
-    free(_localBrightness);
-    _localBrightness = brightness;
-    _flushLUT();
+    for (size_t i = 0; i < pixelCount; ++i) {
+        _localBrightness[i] = uint8_t(std::max(0.0f, std::min(brightness[i], 1.0f)) * 255.0f + 0.5f);
+    }
+    delete[] brightness;
+    _markLocalBrightness(0, pixelCount);
+}
+
+void Renderer::setLocalBrightness(size_t start, size_t end, uint8_t brightness) {
+    end = std::min(end, pixelCount);
+    if (start >= end)
+        return;
+
+    memset(_localBrightness + start, brightness, end - start);
+    _markLocalBrightness(start, end);
+}
+
+void Renderer::setLocalBrightness(size_t start, const uint8_t *brightness, size_t count) {
+    size_t end = std::min(start + count, pixelCount);
+    if (start >= end)
+        return;
+
+    memcpy(_localBrightness + start, brightness, end - start);
+    _markLocalBrightness(start, end);
+}
+
+void Renderer::_markLocalBrightness(size_t start, size_t end) {
+    // Single bytes are written atomically; the worst a render running
+    // in between can do is pick up part of the change a frame early.
+    portENTER_CRITICAL(&_localBrightnessMux);
+    _localBrightnessStart = std::min(_localBrightnessStart, start);
+    _localBrightnessEnd = std::max(_localBrightnessEnd, end);
+    portEXIT_CRITICAL(&_localBrightnessMux);
+}
+
+void Renderer::_updateLocalBrightness() {
+    // Racy peek, to skip the lock most frames; a change we miss
+    // is still marked and gets picked up next frame.
+    if (_localBrightnessStart >= _localBrightnessEnd)
+        return;
+
+    portENTER_CRITICAL(&_localBrightnessMux);
+    size_t start = _localBrightnessStart, end = _localBrightnessEnd;
+    _localBrightnessStart = pixelCount;
+    _localBrightnessEnd = 0;
+    portEXIT_CRITICAL(&_localBrightnessMux);
+
+    _flushComponentLUT(start, end);
 }
 
 
 void Renderer::setResponse(float response) {
-    _response = response;
-    _flushLUT();
+    _startFade(_brightness, response, 0);
 }
 
 float Renderer::getResponse() {
@@ -88,26 +267,141 @@ float Renderer::getResponse() {
 
 void Renderer::setColorCorrection(PRGB correction) {
     _colorCorrection = correction;
-    _flushLUT();
+    _flushComponentLUT();
 }
 
 PRGB Renderer::getColorCorrection() {
     return _colorCorrection;
 }
 
+void Renderer::setCalibration(PRGB *calibration) {
+    delete[] _calibration;
+    _calibration = calibration;
+    _flushComponentLUT();
+}
+
+PRGB *Renderer::getCalibration() {
+    return _calibration;
+}
+
 void Renderer::setBrightness(float brightness) {
-    _brightness = brightness;
-    _flushLUT();
+    _startFade(brightness, _response, 0);
 }
 
 float Renderer::getBrightness() {
     return _brightness;
 }
 
+void Renderer::fadeBrightness(float brightness, unsigned long durationMicros) {
+    _startFade(brightness, _response, durationMicros);
+}
+
+void Renderer::fadeResponse(float response, unsigned long durationMicros) {
+    _startFade(_brightness, response, durationMicros);
+}
+
+bool Renderer::isFading() const {
+    return _isFading;
+}
+
+void Renderer::_startFade(float brightness, float response, unsigned long durationMicros) {
+    // Continue from wherever the running fade is right now
+    float progress = _isFading ? float(micros() - _fadeStart) / float(_fadeDuration) : 1;
+    progress = std::min(progress, 1.0f);
+    _fadeBrightnessFrom = _isFading ? _fadeBrightnessFrom + (_brightness - _fadeBrightnessFrom) * progress : _brightness;
+    _fadeResponseFrom = _isFading ? _fadeResponseFrom + (_response - _fadeResponseFrom) * progress : _response;
+
+    _brightness = brightness;
+    _response = response;
+
+    if (durationMicros == 0 || (_fadeBrightnessFrom == _brightness && _fadeResponseFrom == _response)) {
+        _isFading = false;
+        _flushBrightnessLUT();
+        return;
+    }
+
+    // Build the tables for the brighter end, and scale down from there
+    _fadeBrightnessBase = std::max(_fadeBrightnessFrom, _brightness);
+
+    if (!_fadeFromLUT) {
+        _fadeFromLUT = new uint32_t[256];
+        _fadeToLUT = new uint32_t[256];
+    }
+
+    if (_fadeResponseFrom != _response)
+        _fillBrightnessLUT(_fadeFromLUT, _fadeBrightnessBase, _fadeResponseFrom);
+    _fillBrightnessLUT(_fadeToLUT, _fadeBrightnessBase, _response);
+
+    _isFading = true;
+    _fadeStart = micros();
+    _fadeDuration = durationMicros;
+    _updateFade();
+}
+
+void Renderer::_updateFade() {
+    if (!_isFading)
+        return;
+
+    setDirty();
+
+    unsigned long elapsed = micros() - _fadeStart;
+    if (elapsed >= _fadeDuration) {
+        // Settled; bake the target into the table again
+        _isFading = false;
+        _flushBrightnessLUT();
+        return;
+    }
+
+    // Rescale (of 2^16) from _fadeBrightnessBase to the current brightness.
+    // An 8 bit factor would step visibly near black.
+    float brightness = _fadeBrightnessFrom + (_brightness - _fadeBrightnessFrom) * float(elapsed) / float(_fadeDuration);
+    uint64_t rescale = _fadeBrightnessBase > 0
+        ? uint64_t(std::min(lroundf(brightness / _fadeBrightnessBase * 65536), 65536L))
+        : 0;
+
+    if (_fadeResponseFrom != _response) {
+        // 0 to 256
+        uint64_t progress = uint64_t(elapsed) * 256 / _fadeDuration;
+
+        for (int c = 0; c < 256; ++c) {
+            uint64_t value = (_fadeFromLUT[c] * (256 - progress) + _fadeToLUT[c] * progress) >> 8;
+            _brightnessLUT[c] = uint32_t((value * rescale) >> 16);
+        }
+        return;
+    }
+
+    for (int c = 0; c < 256; ++c) {
+        _brightnessLUT[c] = uint32_t((_fadeToLUT[c] * rescale) >> 16);
+    }
+}
+
 float Renderer::getMaxLightness() {
     return _maxLightness;
 }
 
 void Renderer::setMaxLightness(float lightness) {
     _maxLightness = lightness;
+    _lightnessPrediction = 255;
+    setDirty();
+}
+
+uint8_t Renderer::getMaxLightnessRamp() const {
+    return _maxLightnessRamp;
+}
+
+void Renderer::setMaxLightnessRamp(uint8_t ramp) {
+    _maxLightnessRamp = ramp;
+}
+
+size_t Renderer::bytesPerPixel() {
+    // rgb, _localBrightness, _componentLUT
+    size_t bytes = sizeof(PRGB) + sizeof(uint8_t) + 3 * sizeof(uint8_t);
+
+    if (_usesOutputBuffer())
+        bytes += 3 * sizeof(uint32_t);
+
+    if (_calibration)
+        bytes += sizeof(PRGB);
+
+    return bytes;
 }
@@ -8,6 +8,8 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <freertos/FreeRTOS.h>
+#include <util/IntRoller.h>
 #include "Pixels.h"
 
 class Renderer {
@@ -15,47 +17,214 @@ public:
     size_t pixelCount;
     size_t overflowWall;
     PRGB *rgb;
+    // 16 bit input; nullptr if unused. If set, it replaces rgb.
+    // Not owned; whoever sets it keeps it alive, and calls setDirty().
+    PRGB16 *rgb16 = nullptr;
+
+    // Microseconds spent in each of the last render() calls,
+    // not counting time spent waiting for the output
+    IntRoller *renderTimeHistory;
+    // Microseconds spent waiting for the output to accept each of the last frames
+    IntRoller *transmitWaitHistory;
+
+    // Number of frames where nothing changed and nothing was rendered
+    unsigned long skippedFrames = 0;
+    // Number of frames where only a part of the pixels was rendered
+    unsigned long partialFrames = 0;
+
+    // Microseconds the last rebuild of the per-component lookup table took
+    unsigned long componentLUTFlushTime = 0;
 
     explicit Renderer(size_t pixelCount, size_t overflowWall);
 
-    virtual void render();
+    // Returns false if nothing changed and the frame was skipped
+    bool render();
+
+    bool is16Bit() const;
+
+    // Marks pixels [start, end) as changed. Anyone writing to rgb
+    // must call this, or the change may never be rendered.
+    void setDirty(size_t start, size_t end);
+    void setDirty();
+    bool isDirty() const {
+        return _dirtyStart < _dirtyEnd;
+    }
+    // Pixels marked since the last render; empty if none
+    size_t dirtyStart() const {
+        return _dirtyStart;
+    }
+    size_t dirtyEnd() const {
+        return _dirtyEnd;
+    }
 
     virtual void setColorCorrection(PRGB correction);
     virtual PRGB getColorCorrection();
 
+    // Per-LED color correction, applied on top of the global one.
+    // Takes ownership of the array; nullptr for none.
+    virtual void setCalibration(PRGB *calibration);
+    virtual PRGB *getCalibration();
+
     virtual void setBrightness(float brightness);
     virtual float getBrightness();
 
+    // Takes ownership of the array
     virtual void setLocalBrightness(float *brightness);
-    virtual float *getLocalBrightness();
+    // 0 to 255 per pixel. Read only; use the setters to change it.
+    virtual uint8_t *getLocalBrightness();
+
+    // Thread safe. Only the affected pixels' lookup table
+    // entries are rebuilt, at the start of the next render().
+    // Sets pixels [start, end) to brightness (0 to 255).
+    void setLocalBrightness(size_t start, size_t end, uint8_t brightness);
+    // Copies count values (0 to 255) to the pixels from start on
+    void setLocalBrightness(size_t start, const uint8_t *brightness, size_t count);
 
     // Color intensity response, for rescaled colors
     virtual void setResponse(float response);
     virtual float getResponse();
 
+    // Moves brightness / response to the target over some time.
+    // The lookup tables are only computed when the fade starts; in between,
+    // the brightness table is rescaled from them each frame, in 16 bit.
+    // Getters return the target right away.
+    void fadeBrightness(float brightness, unsigned long durationMicros);
+    void fadeResponse(float response, unsigned long durationMicros);
+    bool isFading() const;
+
     // Maximum number of color components set to '1' (or some ratio thereof)
     virtual void setMaxLightness(float lightness);
     virtual float getMaxLightness();
-protected:
-    float _response;
-    float _brightness;
-    float *_localBrightness;
-    PRGB _colorCorrection;
 
-    // Array of 0-255^4 values used temporarily when render() is called
-    uint32_t *_rgbOutput;
+    // When the power limit relaxes, brighten up by at most
+    // this much (of 255) per frame. 0 to brighten up immediately.
+    uint8_t getMaxLightnessRamp() const;
+    void setMaxLightnessRamp(uint8_t ramp);
+
+    // Heap memory used per pixel, including output buffers
+    virtual size_t bytesPerPixel();
+
+    // Microseconds the output takes to send one frame; 0 if unknown
+    virtual unsigned long transmitMicros() { return 0; }
+    // If true, the next frame is encoded while the last one is being sent
+    virtual bool isPipelined() { return false; }
+
+    // Microseconds the last render() call waited for the output
+    unsigned long lastTransmitWait() const {
+        return _transmitWait;
+    }
+protected:
+    float _response = 1;
+    float _brightness = 1;
+    // 0 to 255 per pixel
+    uint8_t *_localBrightness;
+    // Pixels whose local brightness changed since the last render() call.
+    // Guarded by _localBrightnessMux, since any task may change them.
+    size_t _localBrightnessStart, _localBrightnessEnd;
+    portMUX_TYPE _localBrightnessMux = portMUX_INITIALIZER_UNLOCKED;
+    PRGB _colorCorrection = PRGB::white;
+    PRGB *_calibration = nullptr;
+
+    // Array of 0-255^4 values used temporarily when render() is called.
+    // Only allocated once needed; renderers that encode
+    // straight from rgb can do without.
+    uint32_t *_rgbOutput = nullptr;
     // Remapping array from 0-255 values to 0-255^3 values
     uint32_t *_brightnessLUT;
     // Factor array for each local component. 0 to 255.
-    uint32_t *_componentLUT;
-
-    float _maxLightness;
+    uint8_t *_componentLUT;
+
+    float _maxLightness = 0;
+    uint8_t _maxLightnessRamp = 0;
+    // Power limit rescale (of 255) expected for the current frame,
+    // based on the previous one
+    uint32_t _lightnessPrediction = 255;
+    // How far off the prediction may be before a frame is corrected
+    static const uint32_t _lightnessTolerance = 4;
+
+    // Brightness and response at the start of the fade, if fading
+    bool _isFading = false;
+    float _fadeBrightnessFrom, _fadeResponseFrom;
+    unsigned long _fadeStart, _fadeDuration;
+    // Brightness the fade's lookup tables were built with
+    float _fadeBrightnessBase;
+    // Lookup tables for the start and target response at _fadeBrightnessBase;
+    // _fadeFromLUT is only filled if the response fades.
+    // Only allocated once needed.
+    uint32_t *_fadeFromLUT = nullptr;
+    uint32_t *_fadeToLUT = nullptr;
+
+    // Microseconds waited for the output during the current render() call
+    unsigned long _transmitWait = 0;
+
+    // Pixels changed since the last render() call
+    size_t _dirtyStart, _dirtyEnd;
+    // Pixels to render during the current render() call
+    size_t _frameStart, _frameEnd;
+
+    // If true, the output changes from frame to frame
+    // even if the input doesn't, so no frame may be skipped.
+    virtual bool _isVolatile() { return false; }
+
+    // Computes the output from rgb and passes it on
+    virtual void _render();
+    template <bool wide>
+    void _renderOutput();
+
+    // 0 to 255^3 for input component i, from rgb or rgb16
+    template <bool wide>
+    __attribute__((always_inline)) inline uint32_t _lookup(size_t i) {
+        if (wide)
+            return _lookup16(reinterpret_cast<uint16_t *>(rgb16)[i]);
+
+        return _brightnessLUT[reinterpret_cast<uint8_t *>(rgb)[i]];
+    }
+
+    // Interpolates the lookup table; value / 257 is the 8 bit equivalent
+    inline uint32_t _lookup16(uint32_t value) __attribute__((always_inline)) {
+        uint32_t index = value / 257;
+        uint32_t fraction = value - index * 257;
+        if (fraction == 0)
+            return _brightnessLUT[index];
+
+        // The table only ever goes up, and 255^3 * 256 fits
+        uint32_t low = _brightnessLUT[index];
+        return low + (_brightnessLUT[index + 1] - low) * fraction / 257;
+    }
+
+    // If false, the renderer never uses _rgbOutput
+    virtual bool _usesOutputBuffer() { return true; }
 
     // Flushes the current output to be rendered
     virtual void _flush() {};
 
-    // Flushes the lookup table
-    void _flushLUT();
+    // Flushes the lookup table for brightness and response
+    void _flushBrightnessLUT();
+    // Flushes the lookup table for local brightness, color correction and calibration
+    void _flushComponentLUT();
+    // Same, for pixels [start, end)
+    void _flushComponentLUT(size_t start, size_t end);
+    void _markLocalBrightness(size_t start, size_t end);
+    // Flushes the lookup table for local brightness changed since the last call
+    void _updateLocalBrightness();
+    static void _fillBrightnessLUT(uint32_t *lut, float brightness, float response);
+
+    void _startFade(float brightness, float response, unsigned long durationMicros);
+    // Advances the fade to the current time
+    void _updateFade();
+
+    // 0 to 255, where 255 is no rescale.
+    // Only valid if _maxLightness is set.
+    uint32_t _lightnessRescale(uint64_t totalLightness);
+
+    // Rescale (of 255) for the current frame, from the power limit.
+    // Fades are in the lookup table already.
+    uint32_t _frameRescale();
+
+    // Call with the unscaled total of a frame rendered with _frameRescale().
+    // Updates the prediction, and returns true if the frame
+    // was too bright and needs to be redone with it.
+    bool _updateLightnessPrediction(uint64_t totalLightness);
 };
 
 
@@ -13,32 +13,182 @@
 #include <util/TextFiles.h>
 #include <util/StringRep.h>
 #include <numeric>
+#include <utility>
 #include <esp32-hal.h>
 
 #include "behavior/StrobeDemo.h"
+#include "behavior/ArtnetLive.h"
 
 
-// FIXME This should definitely be per-instance
-
-Screen::Screen(Renderer *renderer)
-: renderer(renderer), bufferSize(renderer->pixelCount) {
-    buffer = new PRGB[bufferSize]{PRGB::black};
+Screen::Screen(Renderer *renderer, String confPrefix)
+: renderer(renderer), confPrefix(std::move(confPrefix)), bufferSize(renderer->pixelCount) {
     pixels = renderer->rgb;
+    capture = new FrameCapture(renderer->pixelCount);
+
+    _readTopology();
+    _source = pixels;
+    _liveBehavior = new ArtnetLive();
 
     readConfig();
 }
 
 void Screen::readConfig() {
-    renderer->setBrightness(StringRep::toFloat(TextFiles::readConf("brightness"), 1.0f));
-    setResponse(StringRep::toFloat(TextFiles::readConf("response"), 1));
+    renderer->setBrightness(StringRep::toFloat(TextFiles::readConf(confPath("brightness")), 1.0f));
+    setResponse(StringRep::toFloat(TextFiles::readConf(confPath("response")), 1));
+    // Nothing new to write back
+    _isConfigChanged = false;
+    readCalibration();
+}
+
+void Screen::writeConfig() {
+    if (!_isConfigChanged)
+        return;
+    _isConfigChanged = false;
+
+    TextFiles::writeConf(confPath("brightness"), String(getBrightness()));
+    TextFiles::writeConf(confPath("response"), String(getResponse()));
+}
+
+void Screen::_readTopology() {
+    if (!TextFiles::hasConf(confPath(TOPOLOGY_CONF)))
+        return;
+
+    topology = Topology::parse(TextFiles::readConf(confPath(TOPOLOGY_CONF)), getPixelCount());
+    if (!topology)
+        return;
+
+    // One more, always black, for unmapped pixels to gather
+    pixels = new PRGB[topology->logicalCount + 1]{PRGB::black};
+    bufferSize = int(topology->logicalCount);
+
+    SerialLog.print("Loaded topology: ").print(int(topology->runs.size())).print(" runs, ")
+        .print(int(topology->logicalCount)).print(" logical pixels.").ln();
+}
+
+void Screen::readCalibration() {
+    size_t size = getPixelCount() * sizeof(PRGB);
+    // One spare pixel, so a longer file reads more than size
+    auto calibration = new PRGB[getPixelCount() + 1];
+
+    if (TextFiles::readConfBytes(confPath(CALIBRATION_CONF), reinterpret_cast<uint8_t *>(calibration), size + 1) != size) {
+        // None, or made for some other strip
+        delete[] calibration;
+        renderer->setCalibration(nullptr);
+        return;
+    }
+
+    renderer->setCalibration(calibration);
+    SerialLog.print("Loaded LED calibration; LUT rebuild took ")
+        .print(renderer->componentLUTFlushTime).print("µs").ln();
 }
 
 void Screen::update(unsigned long delayMicros) {
     lastUpdateTimestamp = micros();
+    _deleteRetired();
+    capture->update();
     draw(delayMicros);
 }
 
+void Screen::setBehavior(NativeBehavior *behavior) {
+    if (isLive()) {
+        _retire(_suspendedBehavior);
+        _suspendedBehavior = behavior;
+        return;
+    }
+
+    _retire(this->behavior);
+    this->behavior = behavior;
+}
+
+void Screen::_retire(NativeBehavior *behavior) {
+    if (behavior == _liveBehavior || behavior == nullptr)
+        return;
+
+    _retiredBehaviors.emplace_back(behavior, micros());
+}
+
+void Screen::_deleteRetired() {
+    auto now = micros();
+    auto end = _retiredBehaviors.begin();
+    while (end != _retiredBehaviors.end() && now - end->second >= MICROS_BEHAVIOR_RETIREMENT) {
+        delete end->first;
+        ++end;
+    }
+
+    _retiredBehaviors.erase(_retiredBehaviors.begin(), end);
+}
+
+void Screen::_updateLive() {
+    bool isActive = hasInput && micros() - lastInputTimestamp < MICROS_INPUT_ACTIVE;
+    if (isActive == isLive())
+        return;
+
+    if (isActive) {
+        SerialLog.print("Input active, going live.").ln();
+        _suspendedBehavior = behavior;
+        behavior = _liveBehavior;
+        return;
+    }
+
+    SerialLog.print("Input silent, resuming.").ln();
+    present16(nullptr);
+    present(nullptr);
+    behavior = _suspendedBehavior;
+    _suspendedBehavior = nullptr;
+}
+
+void Screen::present(PRGB *frame) {
+    _frame = frame;
+    _route();
+}
+
+void Screen::present16(PRGB16 *frame) {
+    if (!frame && !_frame16)
+        return;
+
+    _frame16 = frame;
+    _route();
+}
+
+Compositor *Screen::useCompositor() {
+    if (!compositor) {
+        compositor = new Compositor(getLogicalPixelCount());
+        _route();
+    }
+
+    return compositor;
+}
+
+void Screen::_route() {
+    PRGB *source = _frame ? _frame : pixels;
+    PRGB16 *source16 = _frame16;
+
+    // Presented frames become the base the layers go on top of
+    if (compositor) {
+        source = compositor->output;
+        if (source16)
+            source16 = compositor->getOutput16();
+    }
+
+    if (topology) {
+        if (source16 && !_pixels16)
+            _pixels16 = new PRGB16[getPixelCount()];
+
+        _source = source;
+        _source16 = source16;
+        renderer->rgb16 = source16 ? _pixels16 : nullptr;
+    }
+    else {
+        renderer->rgb = source;
+        renderer->rgb16 = source16;
+    }
+
+    renderer->setDirty();
+}
+
 void Screen::draw(unsigned long delayMicros) {
+    _updateLive();
+
     if (behavior == nullptr) {
         // Nothing to show, let's switch back to Demo.
         behavior = new StrobeDemo();
@@ -48,34 +198,88 @@ void Screen::draw(unsigned long delayMicros) {
         auto status = behavior->update(this, delayMicros);
 
         if (status == NativeBehavior::alive || (status == NativeBehavior::purgatory)) {
-            renderer->render();
+            _composite();
+            _render();
             return;
         }
 
-        // Behavior over, reset pointer
+        // Behavior over
+        _retire(behavior);
         behavior = nullptr;
     }
 
-    memset((void *)renderer->rgb, 0, renderer->pixelCount * 3); // Fill black
-    renderer->render();
+    memset((void *)pixels, 0, getLogicalPixelCount() * 3); // Fill black
+    renderer->setDirty();
+    _composite();
+    _render();
+}
+
+void Screen::_composite() {
+    if (!compositor)
+        return;
+
+    // Whatever marked the renderer since the last frame changed the base.
+    // With topology, the marks are physical, so take it all.
+    if (renderer->isDirty()) {
+        if (topology)
+            compositor->setBaseDirty(0, compositor->pixelCount);
+        else
+            compositor->setBaseDirty(renderer->dirtyStart(), renderer->dirtyEnd());
+    }
+
+    if (_frame16)
+        compositor->composite(_frame16, renderer);
+    else
+        compositor->composite(_frame ? _frame : pixels, renderer);
+}
+
+void Screen::_render() {
+    if (topology && renderer->isDirty()) {
+        // Any change may land anywhere physically
+        if (renderer->rgb16)
+            topology->gather(_source16, renderer->rgb16);
+        else
+            topology->gather(_source, renderer->rgb);
+        renderer->setDirty();
+    }
+
+    if (!renderer->render() || !capture->isCapturing())
+        return;
+
+    if (renderer->rgb16)
+        capture->record(renderer->rgb16);
+    else
+        capture->record(renderer->rgb);
+}
+
+bool Screen::startCapture() {
+    bool started = capture->start(CAPTURE_HEAP_RATIO, CAPTURE_MIN_FREE_HEAP);
+
+    SerialLog.print(started ? "Capturing " : "Failed to start capture, fits ")
+        .print(int(capture->capacity)).print(" frames.").ln();
+    return started;
+}
+
+bool Screen::stopCapture() {
+    return capture->stop();
 }
 
-void Screen::setBrightness(float brightness) {
+void Screen::setBrightness(float brightness, unsigned long fadeMicros) {
     // Let's not go overboard with the brightness
-    renderer->setBrightness(std::min(brightness, 255.0f));
-    TextFiles::writeConf("brightness", String(brightness));
+    renderer->fadeBrightness(std::min(brightness, 255.0f), fadeMicros);
+    _isConfigChanged = true;
 }
 
 float Screen::getResponse() const {
     return renderer->getResponse() - float(NATURAL_COLOR_RESPONSE) + 1;
 }
 
-void Screen::setResponse(float response) {
+void Screen::setResponse(float response, unsigned long fadeMicros) {
     response = std::max(1.0f, std::min(10.0f, response));
-    TextFiles::writeConf("response", String(response));
+    _isConfigChanged = true;
 
     response += float(NATURAL_COLOR_RESPONSE) - 1;
-    renderer->setResponse(response);
+    renderer->fadeResponse(response, fadeMicros);
 }
 
 
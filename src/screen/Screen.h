@@ -6,46 +6,156 @@
 #define LED_FAN_SCREEN_H
 
 static const int MICROS_INPUT_ACTIVE = 5000 * 1000;
+// How long replaced behaviors live on, for other tasks reading their name
+static const int MICROS_BEHAVIOR_RETIREMENT = 1000 * 1000;
 
+// Per-LED calibration; 3 bytes (r, g, b) per LED
+static const char *const CALIBRATION_CONF = "calibration";
+// Wiring of the LEDs, see Topology; read once at boot
+static const char *const TOPOLOGY_CONF = "topology";
+
+#include <WString.h>
+#include <vector>
+#include <utility>
 #include <util/IntRoller.h>
 #include <screen/behavior/NativeBehavior.h>
 #include <util/Image.h>
+#include <util/TripleBuffer.h>
 #include "Renderer.h"
+#include "Compositor.h"
+#include "FrameCapture.h"
+#include "Topology.h"
 
 class Screen {
 public:
     Renderer *renderer;
 
+    // Prepended to all of this screen's config files, so screens
+    // don't share them. Empty for the first screen.
+    String confPrefix;
+
     unsigned long lastUpdateTimestamp;
 
-    // Multi-purpose buffer for any input mode
-    PRGB *buffer;
+    // Frames from network input, in logical pixels, plus one black pixel
+    // (see Topology). Written by the network task, shown by ArtnetLive.
+    // Allocated by the input that needs it, if any.
+    TripleBuffer<PRGB> *input = nullptr;
+    // Same, for 16 bit input. Allocated by the network task on first use,
+    // so the render task may see it appear any time.
+    TripleBuffer<PRGB16> *volatile input16 = nullptr;
+    // Logical pixels per input frame
     int bufferSize;
 
+    // Set by the network task on each packet. While input came in
+    // within MICROS_INPUT_ACTIVE, the screen shows it (ArtnetLive).
+    volatile unsigned long lastInputTimestamp = 0;
+    volatile bool hasInput = false;
+
+    // Maps logical pixels to physical ones; nullptr if they're the same
+    Topology *topology = nullptr;
+
+    // Logical pixels, for behaviors to draw into.
+    // Without topology, this is the renderer's rgb.
     PRGB *pixels;
 
+    // Layers stacked on top of what the screen shows, be it pixels or
+    // a presented frame; nullptr until useCompositor().
+    Compositor *compositor = nullptr;
+
+    // Records rendered frames while capturing; see FrameCapture
+    FrameCapture *capture;
+
+    // Read only; use setBehavior to change it
     NativeBehavior *behavior = nullptr;
 
-    Screen(Renderer *renderer);
+    explicit Screen(Renderer *renderer, String confPrefix = "");
+
+    // Path of this screen's config file
+    String confPath(const String &name) const {
+        return confPrefix + name;
+    }
 
     void readConfig();
+    // Writes brightness and response to flash, if they changed since.
+    // Flash writes stall, so call this from outside the render task.
+    void writeConfig();
+    // Reads the per-LED calibration from flash, if there is one for this strip
+    void readCalibration();
 
     void update(unsigned long delayMicros);
 
+    // Takes ownership; the replaced behavior is deleted by update()
+    // after MICROS_BEHAVIOR_RETIREMENT. While live, replaces the
+    // behavior that's resumed once input stops.
+    void setBehavior(NativeBehavior *behavior);
+
     void draw(unsigned long delayMicros);
 
+    // Physical pixels
     int getPixelCount() {
         return renderer->pixelCount;
     }
 
+    int getLogicalPixelCount() {
+        return topology ? int(topology->logicalCount) : getPixelCount();
+    }
+
     float getBrightness() const {
         return renderer->getBrightness();
     };
-    void setBrightness(float brightness);
+    // Fades over the given time, if any
+    void setBrightness(float brightness, unsigned long fadeMicros = 0);
+
+    // Creates the compositor on first use; from then on, the screen shows
+    // its output. Render task only.
+    Compositor *useCompositor();
+
+    // Sizes the capture ring from free heap, see CAPTURE_HEAP_RATIO
+    bool startCapture();
+    bool stopCapture();
+
+    // Shows frame (logical pixels) instead of pixels, without copying,
+    // until called again. nullptr to go back to pixels.
+    void present(PRGB *frame);
+    // Same, for 16 bit frames. While one is shown, it takes
+    // precedence over present()'s, so pass nullptr to switch back.
+    void present16(PRGB16 *frame);
+    bool isLive() const {
+        return behavior == _liveBehavior;
+    }
 
     float getResponse() const;;
-    void setResponse(float response);;
-
+    void setResponse(float response, unsigned long fadeMicros = 0);
+
+private:
+    NativeBehavior *_liveBehavior;
+    // What was running before input came in
+    NativeBehavior *_suspendedBehavior = nullptr;
+    // Replaced behaviors, oldest first, with the time they were retired.
+    // Other tasks may still be reading their name, so they're kept a while.
+    std::vector<std::pair<NativeBehavior *, unsigned long>> _retiredBehaviors;
+    // Frames passed to present() and present16(); nullptr if none
+    PRGB *_frame = nullptr;
+    PRGB16 *_frame16 = nullptr;
+    // Logical pixels the topology gathers from
+    PRGB *_source;
+    // Same for 16 bit frames, gathered into _pixels16 (physical).
+    // _pixels16 is only allocated once needed.
+    PRGB16 *_source16 = nullptr;
+    PRGB16 *_pixels16 = nullptr;
+    // Set by the render task, cleared by writeConfig
+    volatile bool _isConfigChanged = false;
+
+    // Switches to and from live input
+    void _updateLive();
+    void _retire(NativeBehavior *behavior);
+    // Deletes behaviors retired longer than MICROS_BEHAVIOR_RETIREMENT ago
+    void _deleteRetired();
+    void _readTopology();
+    // Points the renderer (or topology) at whatever should be shown
+    void _route();
+    void _composite();
+    void _render();
 };
 
 
@@ -0,0 +1,183 @@
+#ifndef LED_FAN_STATICRENDERER_H
+#define LED_FAN_STATICRENDERER_H
+
+
+#include <util/spi/SPIDMAQueue.h>
+#include <Setup.h>
+#include "Renderer.h"
+#include "Apa102Encoder.h"
+#include "ClocklessSPIEncoder.h"
+
+// Wire order of the components, as indices into (r, g, b)
+template <uint8_t First, uint8_t Second, uint8_t Third>
+struct ColorOrder {
+    static const uint8_t first = First;
+    static const uint8_t second = Second;
+    static const uint8_t third = Third;
+};
+
+typedef ColorOrder<0, 1, 2> RGBOrder;
+typedef ColorOrder<1, 0, 2> GRBOrder;
+typedef ColorOrder<2, 1, 0> BGROrder;
+
+// APA102 and similar, native order BGR
+struct Apa102Output {
+    static const int clockSpeedHz = LED_CLOCK_SPEED_MHZ * 1000 * 1000;
+    static const bool usesClock = true;
+    static const size_t headerBytes = 4;
+    static const size_t bytesPerPixel = 4;
+
+    static constexpr size_t trailerBytes(size_t pixelCount) {
+        return pixelCount / 32 * 4 + 1;
+    }
+
+    Apa102Output() {
+        Apa102Encoder::initTables();
+    }
+
+    // 0 to 255^4 per component
+    template <typename Order>
+    __attribute__((always_inline)) inline void write(uint8_t *stream, uint32_t r, uint32_t g, uint32_t b) const {
+        Apa102Color color = Apa102Encoder::encode(r, g, b);
+        const uint8_t components[3] = { color.red, color.green, color.blue };
+
+        stream[0] = color.brightness;
+        stream[1] = components[Order::first];
+        stream[2] = components[Order::second];
+        stream[3] = components[Order::third];
+    }
+};
+
+// WS2812 and similar, native order GRB. Clock pin unused.
+struct ClocklessOutput {
+    static const int clockSpeedHz = ClocklessSPIEncoder::clockSpeedHz;
+    static const bool usesClock = false;
+    static const size_t headerBytes = 0;
+    static const size_t bytesPerPixel = ClocklessSPIEncoder::bytesPerPixel;
+
+    // The reset doesn't depend on the strip length
+    static constexpr size_t trailerBytes(size_t) {
+        return ClocklessSPIEncoder::resetBytes;
+    }
+
+    ClocklessSPIEncoder encoder;
+
+    // 0 to 255^4 per component
+    template <typename Order>
+    __attribute__((always_inline)) inline void write(uint8_t *stream, uint32_t r, uint32_t g, uint32_t b) const {
+        const uint32_t _255e3 = 255 * 255 * 255;
+        // We may have rounding errors coming out at 256
+        const uint8_t components[3] = {
+            uint8_t(std::min(r / _255e3, uint32_t(255))),
+            uint8_t(std::min(g / _255e3, uint32_t(255))),
+            uint8_t(std::min(b / _255e3, uint32_t(255)))
+        };
+
+        encoder.encode(components[Order::first], stream);
+        encoder.encode(components[Order::second], stream + ClocklessSPIEncoder::bitsPerBit);
+        encoder.encode(components[Order::third], stream + 2 * ClocklessSPIEncoder::bitsPerBit);
+    }
+};
+
+// Drives one strip over SPI, with the whole pipeline fixed at compile time,
+// so the kernel inlines from rgb to the DMA buffer with Count folded in.
+// Output: Chipset stage (Apa102Output, ClocklessOutput).
+// Its usesClock tells whether clockPin is driven.
+// Order: Wire order of the components.
+// PowerLimited: If false, the power limit is compiled out;
+// setMaxLightness does nothing then.
+// Frames are always encoded whole, and without dithering.
+template <typename Output, typename Order, size_t Count, bool PowerLimited>
+class StaticRenderer : public Renderer {
+public:
+    Output output;
+    SPIDMAQueue *queue;
+
+    StaticRenderer(size_t overflowWall, int dataPin, int clockPin, size_t queueDepth = 2)
+    : Renderer(Count, overflowWall) {
+        size_t bufferSize = Output::headerBytes
+            + (Count + overflowWall) * Output::bytesPerPixel
+            + Output::trailerBytes(Count + overflowWall);
+        // Without a clock, the pin stays free for other uses
+        queue = new SPIDMAQueue(HSPI_HOST, 2, dataPin, Output::usesClock ? clockPin : -1,
+                                Output::clockSpeedHz, bufferSize, queueDepth);
+
+        // Header and trailer are all 0, which SPIDMAQueue already took care of.
+        // The overflow wall is never touched by the kernel, so black it out once.
+        for (size_t i = 0; i < queue->queueDepth; ++i) {
+            uint8_t *stream = queue->buffers[i] + Output::headerBytes;
+            for (size_t p = Count; p < Count + overflowWall; ++p) {
+                output.template write<Order>(stream + p * Output::bytesPerPixel, 0, 0, 0);
+            }
+        }
+    }
+
+    size_t bytesPerPixel() override {
+        // Encoded frame per DMA buffer
+        return Renderer::bytesPerPixel() + Output::bytesPerPixel * queue->queueDepth;
+    }
+
+    unsigned long transmitMicros() override {
+        return queue->transmitMicros(queue->bufferSize);
+    }
+
+    bool isPipelined() override {
+        return queue->queueDepth > 1;
+    }
+
+protected:
+    bool _usesOutputBuffer() override { return false; }
+
+    void _render() override {
+        _transmitWait += queue->acquire();
+        uint8_t *stream = queue->buffer() + Output::headerBytes;
+
+        if (rgb16)
+            _renderFrom<true>(stream);
+        else
+            _renderFrom<false>(stream);
+
+        queue->transmit(queue->bufferSize);
+    }
+
+    template <bool wide>
+    __attribute__((always_inline)) inline void _renderFrom(uint8_t *stream) {
+        uint32_t frameRescale = PowerLimited ? _frameRescale() : 255;
+        uint64_t totalLightness = frameRescale >= 255
+            ? _encode<wide, false>(stream, 255)
+            : _encode<wide, true>(stream, frameRescale);
+
+        if (PowerLimited && _maxLightness > 0 && _updateLightnessPrediction(totalLightness)) {
+            // Prediction was way off; too much power used, need to re-encode :(
+            _encode<wide, true>(stream, _frameRescale());
+        }
+    }
+
+    // Returns the total lightness before rescaling, if PowerLimited
+    template <bool wide, bool rescaled>
+    __attribute__((always_inline)) inline uint64_t _encode(uint8_t *stream, uint32_t lightnessRescale) {
+        uint64_t totalLightness = 0;
+
+        for (size_t i = 0; i < Count * 3; i += 3, stream += Output::bytesPerPixel) {
+            uint32_t r_r = _lookup<wide>(i) * _componentLUT[i];
+            uint32_t g_r = _lookup<wide>(i + 1) * _componentLUT[i + 1];
+            uint32_t b_r = _lookup<wide>(i + 2) * _componentLUT[i + 2];
+
+            if (PowerLimited)
+                totalLightness += uint64_t(r_r) + g_r + b_r;
+
+            if (rescaled) {
+                r_r = r_r / 255 * lightnessRescale;
+                g_r = g_r / 255 * lightnessRescale;
+                b_r = b_r / 255 * lightnessRescale;
+            }
+
+            output.template write<Order>(stream, r_r, g_r, b_r);
+        }
+
+        return totalLightness;
+    }
+};
+
+
+#endif //LED_FAN_STATICRENDERER_H
@@ -0,0 +1,136 @@
+#include "Topology.h"
+
+#include <util/Logger.h>
+#include <cctype>
+
+Topology *Topology::parse(const String &description, size_t pixelCount) {
+    auto topology = new Topology(pixelCount);
+
+    int lineStart = 0;
+    while (lineStart < (int) description.length()) {
+        int lineEnd = description.indexOf('\n', lineStart);
+        if (lineEnd < 0)
+            lineEnd = description.length();
+
+        String line = description.substring(lineStart, lineEnd);
+        line.trim();
+        lineStart = lineEnd + 1;
+
+        if (line.length() == 0 || line.startsWith("#"))
+            continue;
+
+        if (!topology->_addRun(line)) {
+            SerialLog.print("Topology: Can't read '").print(line).print("'").ln();
+            delete topology;
+            return nullptr;
+        }
+    }
+
+    if (!topology->_compile()) {
+        delete topology;
+        return nullptr;
+    }
+
+    return topology;
+}
+
+Topology::~Topology() {
+    delete[] _gather;
+}
+
+bool Topology::_readCount(const String &word, size_t &value) {
+    // toInt() takes signs and junk, and overflows
+    if (word.length() == 0 || word.length() > 5)
+        return false;
+    for (int i = 0; i < (int) word.length(); ++i) {
+        if (!isdigit(word[i]))
+            return false;
+    }
+
+    value = size_t(word.toInt());
+    return value <= maxLogicalCount;
+}
+
+bool Topology::_addRun(const String &line) {
+    String words[5];
+    int wordCount = 0;
+
+    for (int i = 0; i < (int) line.length();) {
+        int end = line.indexOf(' ', i);
+        if (end < 0)
+            end = line.length();
+        if (end > i) {
+            if (wordCount == 5)
+                return false;
+            words[wordCount++] = line.substring(i, end);
+        }
+        i = end + 1;
+    }
+
+    Run run = { logicalCount, 0, 0, 1, false, false };
+
+    if (words[0] == "strip" && (wordCount == 3 || wordCount == 4)) {
+        if (!_readCount(words[1], run.physicalStart) || !_readCount(words[2], run.width))
+            return false;
+
+        run.reverse = wordCount == 4;
+        if (run.reverse && words[3] != "reverse")
+            return false;
+    }
+    else if (words[0] == "matrix" && (wordCount == 4 || wordCount == 5)) {
+        if (!_readCount(words[1], run.physicalStart) || !_readCount(words[2], run.width)
+            || !_readCount(words[3], run.height))
+            return false;
+
+        run.serpentine = wordCount == 5;
+        if (run.serpentine && words[4] != "serpentine")
+            return false;
+    }
+    else
+        return false;
+
+    if (run.width == 0 || run.height == 0)
+        return false;
+
+    // Neither count() nor logicalCount may overflow
+    if (run.width > maxLogicalCount / run.height || run.count() > maxLogicalCount - logicalCount) {
+        SerialLog.print("Topology: Too many pixels.").ln();
+        return false;
+    }
+
+    if (run.physicalStart >= pixelCount || run.count() > pixelCount - run.physicalStart) {
+        SerialLog.print("Topology: Run at ").print(int(run.physicalStart)).print(" exceeds the strip.").ln();
+        return false;
+    }
+
+    runs.push_back(run);
+    logicalCount += run.count();
+    return true;
+}
+
+bool Topology::_compile() {
+    // Runs are checked against the strip and maxLogicalCount already
+    _gather = new uint16_t[pixelCount];
+    // Unmapped pixels read the black pixel past the end
+    for (size_t p = 0; p < pixelCount; ++p)
+        _gather[p] = uint16_t(logicalCount);
+
+    for (auto &run : runs) {
+        for (size_t y = 0; y < run.height; ++y) {
+            for (size_t x = 0; x < run.width; ++x) {
+                size_t wired = y * run.width + (run.serpentine && y % 2 == 1 ? run.width - 1 - x : x);
+                if (run.reverse)
+                    wired = run.count() - 1 - wired;
+
+                uint16_t &target = _gather[run.physicalStart + wired];
+                if (target != logicalCount) {
+                    SerialLog.print("Topology: Runs overlap at ").print(int(run.physicalStart + wired)).ln();
+                    return false;
+                }
+                target = uint16_t(run.logicalStart + y * run.width + x);
+            }
+        }
+    }
+
+    return true;
+}
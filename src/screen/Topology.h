@@ -0,0 +1,72 @@
+#ifndef LED_FAN_TOPOLOGY_H
+#define LED_FAN_TOPOLOGY_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <WString.h>
+#include "Pixels.h"
+
+// Maps logical pixels, which behaviors and network input draw into,
+// to physical ones, in the order they are wired.
+// Described by one run per line; logical pixels are numbered run by run,
+// row-major within each run. Lines starting with # are skipped.
+//   strip <physical start> <count> [reverse]
+//   matrix <physical start> <width> <height> [serpentine]
+// With serpentine, every other row is wired right to left.
+// Physical pixels outside any run stay black.
+class Topology {
+public:
+    struct Run {
+        size_t logicalStart, physicalStart;
+        size_t width, height;
+        bool reverse, serpentine;
+
+        size_t count() const {
+            return width * height;
+        }
+    };
+
+    static const size_t maxLogicalCount = UINT16_MAX - 1;
+
+    // Physical pixels
+    size_t pixelCount;
+    size_t logicalCount = 0;
+    std::vector<Run> runs;
+
+    // Returns nullptr (and logs why) if the description doesn't fit the strip
+    static Topology *parse(const String &description, size_t pixelCount);
+
+    ~Topology();
+
+    // Logical index of pixel (x, y) in the given run
+    size_t index(size_t run, size_t x, size_t y = 0) const {
+        return runs[run].logicalStart + y * runs[run].width + x;
+    }
+
+    // Copies physical pixels from logical ones (PRGB or PRGB16). logical needs
+    // one extra (black) pixel past logicalCount, which unmapped pixels read from.
+    template <typename Pixel>
+    void gather(const Pixel *logical, Pixel *physical) const {
+        const uint16_t *index = _gather;
+        const uint16_t *end = _gather + pixelCount;
+
+        while (index < end)
+            *(physical++) = logical[*(index++)];
+    }
+
+private:
+    // Logical index for each physical pixel
+    uint16_t *_gather = nullptr;
+
+    explicit Topology(size_t pixelCount) : pixelCount(pixelCount) {}
+
+    // Reads a plain decimal of at most maxLogicalCount
+    static bool _readCount(const String &word, size_t &value);
+    bool _addRun(const String &line);
+    bool _compile();
+};
+
+
+#endif //LED_FAN_TOPOLOGY_H
@@ -0,0 +1,16 @@
+#include "ArtnetLive.h"
+#include <screen/Screen.h>
+
+NativeBehavior::Status ArtnetLive::update(Screen *screen, unsigned long delay) {
+    TripleBuffer<PRGB16> *input16 = screen->input16;
+    if (input16 && input16->update())
+        screen->present16(input16->front());
+
+    // Whichever width came in last is shown
+    if (screen->input && screen->input->update()) {
+        screen->present16(nullptr);
+        screen->present(screen->input->front());
+    }
+
+    return alive;
+}
@@ -0,0 +1,16 @@
+#ifndef LED_FAN_ARTNETLIVE_H
+#define LED_FAN_ARTNETLIVE_H
+
+
+#include "NativeBehavior.h"
+
+// Shows the latest complete frame received over Art-Net, 8 or 16 bit, in place.
+// The screen switches to it by itself while input is active.
+class ArtnetLive : public NativeBehavior {
+public:
+    String name() override { return "Art-Net Live"; }
+    NativeBehavior::Status update(Screen *screen, unsigned long delay) override;
+};
+
+
+#endif //LED_FAN_ARTNETLIVE_H
@@ -16,7 +16,13 @@ public:
         dead, alive, purgatory
     };
 
+    virtual ~NativeBehavior() = default;
+
     virtual String name() { return "Unknown Behavior"; };
+    // Draws into screen->pixels (logical). Changed pixels must be marked
+    // through screen->renderer->setDirty, or they may not be rendered.
+    // Runs on the render task, which also deletes the behavior
+    // once it's been replaced for a while.
     virtual Status update(Screen *screen, unsigned long delay);
 };
 
@@ -11,9 +11,14 @@ NativeBehavior::Status Ping::update(Screen *screen, unsigned long delay) {
     if (timeLeft <= 0)
         return dead;
 
-    Renderer *renderer = screen->renderer;
-    PRGB((((timeLeft - 1) / blinkTime) % 2) == 0 ? PRGB::black : PRGB::red)
-        .fill(renderer->rgb, renderer->pixelCount);
+    int blink = int(((timeLeft - 1) / blinkTime) % 2);
+    if (blink != lastBlink) {
+        Renderer *renderer = screen->renderer;
+        PRGB(blink == 0 ? PRGB::black : PRGB::red)
+            .fill(screen->pixels, screen->getLogicalPixelCount());
+        renderer->setDirty();
+        lastBlink = blink;
+    }
 
     timeLeft = timeLeft > delay
         ? timeLeft - delay
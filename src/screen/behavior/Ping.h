@@ -12,6 +12,7 @@ class Ping : public NativeBehavior {
 public:
     unsigned long timeLeft;
     unsigned long blinkTime = 500 * 1000;
+    int lastBlink = -1;
 
     Ping(unsigned long timeLeft);
 
@@ -19,7 +19,8 @@ NativeBehavior::Status StrobeDemo::update(Screen *screen, unsigned long delay) {
 
         Renderer *renderer = screen->renderer;
         PRGB(isWhite ? PRGB::white : PRGB::black)
-            .fill(renderer->rgb, renderer->pixelCount);
+            .fill(screen->pixels, screen->getLogicalPixelCount());
+        renderer->setDirty();
     }
 
     return alive;
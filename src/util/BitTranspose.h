@@ -0,0 +1,33 @@
+#ifndef LED_FAN_BITTRANSPOSE_H
+#define LED_FAN_BITTRANSPOSE_H
+
+#include <cstdint>
+
+class BitTranspose {
+public:
+    // Transposes 8 bytes as an 8x8 bit matrix:
+    // Bit j of out[k] is bit (7 - k) of in[j],
+    // so out[0] collects the most significant bits.
+    static inline void transpose8(const uint8_t *in, uint8_t *out) __attribute__((always_inline)) {
+        // Lower bits are lower rows, so read in reverse
+        uint32_t x = (uint32_t(in[7]) << 24) | (uint32_t(in[6]) << 16) | (uint32_t(in[5]) << 8) | in[4];
+        uint32_t y = (uint32_t(in[3]) << 24) | (uint32_t(in[2]) << 16) | (uint32_t(in[1]) << 8) | in[0];
+        uint32_t t;
+
+        // Hacker's Delight, transpose8rS32
+        t = (x ^ (x >> 7)) & 0x00AA00AAu; x = x ^ t ^ (t << 7);
+        t = (y ^ (y >> 7)) & 0x00AA00AAu; y = y ^ t ^ (t << 7);
+
+        t = (x ^ (x >> 14)) & 0x0000CCCCu; x = x ^ t ^ (t << 14);
+        t = (y ^ (y >> 14)) & 0x0000CCCCu; y = y ^ t ^ (t << 14);
+
+        t = (x & 0xF0F0F0F0u) | ((y >> 4) & 0x0F0F0F0Fu);
+        y = ((x << 4) & 0xF0F0F0F0u) | (y & 0x0F0F0F0Fu);
+        x = t;
+
+        out[0] = uint8_t(x >> 24); out[1] = uint8_t(x >> 16); out[2] = uint8_t(x >> 8); out[3] = uint8_t(x);
+        out[4] = uint8_t(y >> 24); out[5] = uint8_t(y >> 16); out[6] = uint8_t(y >> 8); out[7] = uint8_t(y);
+    }
+};
+
+#endif //LED_FAN_BITTRANSPOSE_H
@@ -43,6 +43,18 @@ float IntRoller::mean() {
     return (float) sum() / (float) count;
 }
 
+int IntRoller::percentile(float ratio) {
+    int *sorted = new int[count];
+    std::copy(data, data + count, sorted);
+
+    auto index = std::min(count - 1, (unsigned int) (ratio * float(count)));
+    std::nth_element(sorted, sorted + index, sorted + count);
+    int value = sorted[index];
+
+    delete[] sorted;
+    return value;
+}
+
 int IntRoller::countOccurrences(int v) {
     int c = 0;
     for (int i = 0; i < count; ++i) {
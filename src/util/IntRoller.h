@@ -31,6 +31,8 @@ public:
 
     int sum();
     float mean();
+    // Value that ratio (0 to 1) of the entries are at or below
+    int percentile(float ratio);
 
     RollerIterator<int> begin() { return {data, head, count}; }
     RollerIterator<int> end() { return {}; }
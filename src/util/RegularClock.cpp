@@ -7,7 +7,29 @@
 #include <climits>
 
 RegularClock::RegularClock(unsigned long microsecondsPerFrame, int historyLength)
-: lastSyncTimestamp(INT_MAX), microsecondsPerFrame(microsecondsPerFrame), frameTimeHistory(new IntRoller(historyLength)) {}
+: lastSyncTimestamp(INT_MAX), microsecondsPerFrame(microsecondsPerFrame), frameTimeHistory(new IntRoller(historyLength)) {
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = &RegularClock::_wake;
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "clock";
+    ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &_wakeTimer));
+}
+
+void RegularClock::_wake(void *arg) {
+    xTaskNotifyGive(static_cast<RegularClock *>(arg)->_sleepingTask);
+}
+
+void RegularClock::_sleep(unsigned long delay) {
+    if (delay < MIN_SLEEP_MICROS) {
+        delayMicroseconds(delay);
+        return;
+    }
+
+    _sleepingTask = xTaskGetCurrentTaskHandle();
+    esp_timer_start_once(_wakeTimer, delay);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
 
 unsigned long RegularClock::sync() {
     unsigned long microseconds = micros();
@@ -29,14 +51,15 @@ unsigned long RegularClock::sync() {
         // factor it into the next frame time to sync better
         lastSyncTimestamp = microseconds + delay;
 
-        unsigned long delayTicks = delay / portTICK_PERIOD_MS;
+        // delay is in microseconds, ticks are milliseconds apart
+        unsigned long delayTicks = delay / (portTICK_PERIOD_MS * 1000);
         if (delayTicks > 2) {
             // Worth it to yield
             vTaskDelay(delayTicks);
-            delay -= delayTicks * portTICK_PERIOD_MS;
+            delay -= delayTicks * portTICK_PERIOD_MS * 1000;
         }
 
-        delayMicroseconds(delay);
+        _sleep(delay);
     }
     else
         // Can't keep up! Accept lower framerate and just continue running.
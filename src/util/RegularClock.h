@@ -5,8 +5,14 @@
 #ifndef LED_FAN_REGULARCLOCK_H
 #define LED_FAN_REGULARCLOCK_H
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
 #include "IntRoller.h"
 
+// Shorter waits are spun; waking up through a timer costs about as much
+static const unsigned long MIN_SLEEP_MICROS = 50;
+
 class RegularClock {
 public:
     unsigned long lastSyncTimestamp;
@@ -17,7 +23,17 @@ public:
 
     RegularClock(unsigned long microsecondsPerFrame, int historyLength);
 
+    // Waits out the rest of the frame, blocking the calling task
+    // so lower priority tasks on its core get to run meanwhile.
     unsigned long sync();
+
+private:
+    esp_timer_handle_t _wakeTimer;
+    TaskHandle_t _sleepingTask = nullptr;
+
+    static void _wake(void *arg);
+    // Blocks for delay microseconds, to the microsecond; shorter than a tick is fine.
+    void _sleep(unsigned long delay);
 };
 
 
@@ -37,6 +37,18 @@ String TextFiles::read(String path) {
     return string;
 }
 
+size_t TextFiles::readBytes(String path, uint8_t *data, size_t size) {
+    File file = SPIFFS.open(path, FILE_READ);
+
+    if(!file){
+        return 0;
+    }
+
+    size_t read = file.read(data, size);
+    file.close();
+    return read;
+}
+
 bool TextFiles::hasConf(String path) {
     return has(CFG_PATH + path);
 }
@@ -48,3 +60,7 @@ bool TextFiles::writeConf(String path, String s) {
 String TextFiles::readConf(String path) {
     return read(CFG_PATH + path);
 }
+
+size_t TextFiles::readConfBytes(String path, uint8_t *data, size_t size) {
+    return readBytes(CFG_PATH + path, data, size);
+}
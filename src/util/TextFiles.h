@@ -17,9 +17,13 @@ public:
     static bool write(String path, String s);
     static String read(String path);
 
+    // Returns the number of bytes read
+    static size_t readBytes(String path, uint8_t *data, size_t size);
+
     static bool hasConf(String path);
     static bool writeConf(String path, String s);
     static String readConf(String path);
+    static size_t readConfBytes(String path, uint8_t *data, size_t size);
 };
 
 
@@ -0,0 +1,77 @@
+#ifndef LED_FAN_TRIPLEBUFFER_H
+#define LED_FAN_TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Hands frames from one writer task to one reader task, without locks or copies.
+// The writer fills back() and publish()es it; the reader calls update()
+// and reads front(), which stays untouched until its next update().
+// Neither side ever waits, and the reader only ever sees whole frames.
+// T must be trivially copyable; buffers start out zeroed.
+template<typename T>
+class TripleBuffer {
+public:
+    const size_t count;
+
+    explicit TripleBuffer(size_t count) : count(count) {
+        for (auto &buffer : _buffers) {
+            buffer = new T[count];
+            memset((void *) buffer, 0, count * sizeof(T));
+        }
+    }
+
+    ~TripleBuffer() {
+        for (auto buffer : _buffers)
+            delete[] buffer;
+    }
+
+    // Writer only. After publish(), this is some older frame.
+    T *back() {
+        return _buffers[_back];
+    }
+
+    // Writer only. The frame published last; read-only, since the reader may be on it.
+    const T *latest() {
+        return _buffers[_latest];
+    }
+
+    // Writer only. Offers back() to the reader, replacing any frame it hasn't taken yet.
+    void publish() {
+        _latest = _back;
+        uint8_t previous = _middle.exchange(uint8_t(_back | _fresh), std::memory_order_acq_rel);
+        _back = uint8_t(previous & _index);
+    }
+
+    // Reader only. Takes the latest published frame, if there is a new one.
+    // Returns true if front() changed.
+    bool update() {
+        if (!(_middle.load(std::memory_order_acquire) & _fresh))
+            return false;
+
+        uint8_t previous = _middle.exchange(_front, std::memory_order_acq_rel);
+        _front = uint8_t(previous & _index);
+        return true;
+    }
+
+    // Reader only
+    T *front() {
+        return _buffers[_front];
+    }
+
+private:
+    static const uint8_t _index = 3;
+    static const uint8_t _fresh = 4;
+
+    T *_buffers[3];
+
+    uint8_t _back = 0;
+    uint8_t _latest = 2;
+    // Index of the buffer between writer and reader, plus _fresh if it's unread
+    std::atomic<uint8_t> _middle{1};
+    uint8_t _front = 2;
+};
+
+#endif //LED_FAN_TRIPLEBUFFER_H
@@ -0,0 +1,64 @@
+#ifndef LED_FAN_ESP32APA102CONTROLLER_H
+#define LED_FAN_ESP32APA102CONTROLLER_H
+
+#include <FastLED.h>
+#include "ESP32SPI.h"
+
+// Drop-in for FastLED's APA102Controller. Instead of handing ESP32SPI
+// 4 bytes per LED, it prepares one word per LED and writes the frame
+// to the DMA buffer in one block, with one bounds check.
+template <uint8_t DATA_PIN, uint8_t CLOCK_PIN, EOrder RGB_ORDER = BGR, uint32_t SPI_SPEED = DATA_RATE_MHZ(12)>
+class ESP32Apa102Controller : public CPixelLEDController<RGB_ORDER> {
+public:
+    typedef SPIOutput<DATA_PIN, CLOCK_PIN, SPI_SPEED> Output;
+
+    void init() override {
+        _spi.init();
+    }
+
+protected:
+    void showPixels(PixelController<RGB_ORDER> &pixels) override {
+        int pixelCount = pixels.size();
+        if (pixelCount > _wordCount) {
+            delete[] _words;
+            _words = new uint32_t[pixelCount];
+            _wordCount = pixelCount;
+        }
+
+        uint8_t s0 = pixels.getScale0(), s1 = pixels.getScale1(), s2 = pixels.getScale2();
+#if FASTLED_USE_GLOBAL_BRIGHTNESS == 1
+        // Same as APA102Controller: move the scale into the 5 bit brightness
+        const uint16_t maxBrightness = 0x1F;
+        uint16_t brightness = ((((uint16_t) max(max(s0, s1), s2) + 1) * maxBrightness - 1) >> 8) + 1;
+        s0 = (maxBrightness * s0 + (brightness >> 1)) / brightness;
+        s1 = (maxBrightness * s1 + (brightness >> 1)) / brightness;
+        s2 = (maxBrightness * s2 + (brightness >> 1)) / brightness;
+#else
+        const uint8_t brightness = 0x1F;
+#endif
+        const uint32_t header = 0xE0 | brightness;
+
+        // Little endian, so the header goes out first
+        for (int i = 0; pixels.has(1); ++i) {
+            uint32_t c0 = pixels.loadAndScale0(0, s0);
+            uint32_t c1 = pixels.loadAndScale1(0, s1);
+            uint32_t c2 = pixels.loadAndScale2(0, s2);
+            _words[i] = header | (c0 << 8) | (c1 << 16) | (c2 << 24);
+
+            pixels.stepDithering();
+            pixels.advanceData();
+        }
+
+        // release() drops the frame if it didn't fit
+        _spi.select();
+        _spi.writeApa102Frame(_words, pixelCount);
+        _spi.release();
+    }
+
+private:
+    Output _spi;
+    uint32_t *_words = nullptr;
+    int _wordCount = 0;
+};
+
+#endif //LED_FAN_ESP32APA102CONTROLLER_H
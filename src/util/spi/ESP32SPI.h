@@ -9,21 +9,21 @@
 #include <FastLED.h>
 #include <util/Logger.h>
 #include <SPITools.h>
+#include "SPIFrameWriter.h"
 
+// FastLED's SPIOutput. FastLED's own controllers hand over every byte on
+// its own; ESP32Apa102Controller writes whole frames instead.
+// Either way, frames that didn't fit are dropped.
 template <uint8_t _DATA_PIN, uint8_t _CLOCK_PIN, uint32_t _CLOCK_SPEED, spi_host_device_t _HOST>
-class ESP32SPI {
+class ESP32SPI : public SPIFrameWriter {
 public:
-    int bufferSize = SPI_BUFFER_SIZE;
-
-    uint8_t* buffer;
-
     SPI_settings_t SPI_settings = {};
 
-    int transactionLength = 0;
-
     spi_transaction_t transactions[2];
     int currentTransaction = 0;
 
+    ESP32SPI() : SPIFrameWriter(SPI_BUFFER_SIZE) {}
+
     void init() {
         esp_err_t err;
 
@@ -76,20 +76,20 @@ public:
 //            ESP_ERROR_CHECK(err);
 //        }
 
-        transactionLength = 0;
+        begin();
     }
 
     void inline release() __attribute__((always_inline)) {
-        if (transactionLength > bufferSize) {
-            SerialLog.print("Too little DMA buffer! Run while you can!").ln();
-            // Oh god, we fucked up
+        if (isOverrun()) {
+            // Nothing was written past the buffer, but the frame is cut off.
             // If you get this error, re-calculate your buffer size
+            SerialLog.print("Too little DMA buffer, dropping frame.").ln();
             return;
         }
 
         spi_transaction_t *transaction = transactions + currentTransaction;
         memset(transaction, 0, sizeof(*transaction));
-        transaction->length = transactionLength * 8; //length is in bits
+        transaction->length = length * 8; //length is in bits
         transaction->tx_buffer = buffer;
 
         auto err = spi_device_queue_trans(SPI_settings.spi, transaction, portMAX_DELAY);
@@ -100,17 +100,6 @@ public:
     }
 
     static void waitFully() { } // No need to wait lol
-
-    void inline writeByte(uint8_t b) __attribute__((always_inline)) {
-        buffer[transactionLength++] = b;
-    }
-
-    void inline writeWord(uint16_t w) __attribute__((always_inline)) {
-//        writeByte(w >> 8);
-//        writeByte(w & 0xff);
-        *reinterpret_cast<uint16_t *>(&buffer[transactionLength]) = (w >> 8) | (w << 8);
-        transactionLength += 2;
-    }
 };
 
 #if defined(SPI_ESP32_HARDWARE_SPI_HOST) && defined(SPI_DATA) && defined(SPI_CLOCK)
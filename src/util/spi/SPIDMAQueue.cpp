@@ -0,0 +1,87 @@
+#include "SPIDMAQueue.h"
+
+#include <algorithm>
+#include <esp32-hal.h>
+#include <util/Logger.h>
+
+SPIDMAQueue::SPIDMAQueue(spi_host_device_t host, int dmaChannel, int dataPin, int clockPin, int clockSpeedHz,
+                         size_t bufferSize, size_t queueDepth)
+: bufferSize(bufferSize), queueDepth(std::max(queueDepth, size_t(1))) {
+    esp_err_t err;
+
+    spi_bus_config_t buscfg = {};
+    buscfg.miso_io_num = -1;
+    buscfg.mosi_io_num = dataPin;
+    buscfg.sclk_io_num = clockPin;
+    buscfg.quadwp_io_num = -1;
+    buscfg.quadhd_io_num = -1;
+    buscfg.max_transfer_sz = bufferSize;
+
+    spi_device_interface_config_t devcfg = {};
+    devcfg.clock_speed_hz = clockSpeedHz;
+    devcfg.mode = 0; //SPI mode 0
+    devcfg.spics_io_num = -1; //CS pin
+    devcfg.queue_size = this->queueDepth;
+    devcfg.command_bits = 0;
+    devcfg.address_bits = 0;
+
+    SPI_settings.host = host;
+    SPI_settings.dma_chan = dmaChannel;
+    SPI_settings.buscfg = buscfg;
+    SPI_settings.devcfg = devcfg;
+
+    err = spi_bus_initialize(SPI_settings.host, &SPI_settings.buscfg, SPI_settings.dma_chan);
+    ESP_ERROR_CHECK(err);
+
+    //Attach the Accel to the SPI bus
+    err = spi_bus_add_device(SPI_settings.host, &SPI_settings.devcfg, &SPI_settings.spi);
+    ESP_ERROR_CHECK(err);
+
+    // Allocate DMA memory
+    buffers = new uint8_t*[this->queueDepth];
+    for (size_t i = 0; i < this->queueDepth; ++i) {
+        buffers[i] = reinterpret_cast<uint8_t *>(heap_caps_malloc(bufferSize, MALLOC_CAP_DMA));
+        if (!buffers[i]) {
+            SerialLog.print("Failed to allocate SPI buffer; possibly too little DMA memory available?").ln();
+            exit(1);
+        }
+        memset(buffers[i], 0, bufferSize);
+    }
+
+    transactions = new spi_transaction_t[this->queueDepth];
+}
+
+unsigned long SPIDMAQueue::acquire() {
+    spi_transaction_t *finished;
+
+    // Transactions complete in order, so every result frees the oldest slot
+    while (transactionsInFlight > 0
+        && spi_device_get_trans_result(SPI_settings.spi, &finished, 0) == ESP_OK) {
+        transactionsInFlight--;
+    }
+
+    if (transactionsInFlight < queueDepth)
+        return 0;
+
+    // All buffers are on the wire; wait for the oldest, which is ours
+    auto start = micros();
+    auto err = spi_device_get_trans_result(SPI_settings.spi, &finished, portMAX_DELAY);
+    ESP_ERROR_CHECK(err);
+    transactionsInFlight--;
+
+    return micros() - start;
+}
+
+void SPIDMAQueue::transmit(size_t length) {
+    spi_transaction_t *transaction = transactions + currentTransaction;
+    memset(transaction, 0, sizeof(*transaction));
+    transaction->length = length * 8; //length is in bits
+    transaction->tx_buffer = buffer();
+
+    auto err = spi_device_queue_trans(SPI_settings.spi, transaction, portMAX_DELAY);
+    ESP_ERROR_CHECK(err);
+    transactionsInFlight++;
+
+    // Cycle to the next buffer
+    currentTransaction = (currentTransaction + 1) % queueDepth;
+}
@@ -0,0 +1,43 @@
+#ifndef LED_FAN_SPIDMAQUEUE_H
+#define LED_FAN_SPIDMAQUEUE_H
+
+
+#include <SPITools.h>
+
+// Sends from a ring of DMA buffers over one SPI bus;
+// while some buffers are on the wire, the next one can be filled.
+class SPIDMAQueue {
+public:
+    SPI_settings_t SPI_settings = {};
+
+    size_t bufferSize;
+    size_t queueDepth;
+    uint8_t **buffers;
+
+    spi_transaction_t *transactions;
+    size_t currentTransaction = 0;
+    size_t transactionsInFlight = 0;
+
+    SPIDMAQueue(spi_host_device_t host, int dmaChannel, int dataPin, int clockPin, int clockSpeedHz,
+                size_t bufferSize, size_t queueDepth);
+
+    // Reclaims finished transactions and returns the next free buffer,
+    // waiting for the oldest transaction if need be.
+    // Returns the microseconds waited.
+    unsigned long acquire();
+
+    uint8_t *buffer() {
+        return buffers[currentTransaction];
+    }
+
+    // Queues the current buffer and cycles to the next one
+    void transmit(size_t length);
+
+    // Microseconds to send length bytes at the configured clock speed
+    unsigned long transmitMicros(size_t length) const {
+        return (unsigned long) (uint64_t(length) * 8 * 1000 * 1000 / SPI_settings.devcfg.clock_speed_hz);
+    }
+};
+
+
+#endif //LED_FAN_SPIDMAQUEUE_H
@@ -0,0 +1,83 @@
+#ifndef LED_FAN_SPIFRAMEWRITER_H
+#define LED_FAN_SPIFRAMEWRITER_H
+
+#include <cstdint>
+#include <cstring>
+
+// Start frame, one word per LED and at least half a bit per LED of end frame
+#define APA102_FRAME_SIZE(pixelCount) (4 + 4 * (pixelCount) + ((pixelCount) + 15) / 16)
+
+// Fills the buffer of one SPI transaction.
+// Writes past the end are counted, but never stored, so an overrun
+// can't corrupt memory and only needs checking once per frame.
+class SPIFrameWriter {
+public:
+    int bufferSize;
+    // Word aligned, for writeApa102Frame
+    uint8_t *buffer = nullptr;
+
+    // Bytes written since begin(), including those that didn't fit
+    int length = 0;
+
+    explicit SPIFrameWriter(int bufferSize) : bufferSize(bufferSize) {}
+
+    void begin() {
+        length = 0;
+    }
+
+    // If true, the frame is incomplete and must not be sent
+    bool isOverrun() const {
+        return length > bufferSize;
+    }
+
+    int inline available() const __attribute__((always_inline)) {
+        return bufferSize - length;
+    }
+
+    void inline writeByte(uint8_t b) __attribute__((always_inline)) {
+        if (length < bufferSize)
+            buffer[length] = b;
+        ++length;
+    }
+
+    // Most significant byte first
+    void inline writeWord(uint16_t w) __attribute__((always_inline)) {
+        if (length + 2 <= bufferSize) {
+            buffer[length] = uint8_t(w >> 8);
+            buffer[length + 1] = uint8_t(w);
+        }
+        length += 2;
+    }
+
+    // Appends a prepared block, or nothing if it doesn't all fit
+    bool writeBytes(const uint8_t *data, int count) {
+        bool fits = count <= available();
+        if (fits)
+            memcpy(buffer + length, data, count);
+        length += count;
+
+        return fits;
+    }
+
+    // Writes a whole APA102 frame word by word, checking bounds once.
+    // pixels: One word per LED, bytes in wire order
+    // (0b111 | brightness, then the components).
+    // Call right after begin().
+    bool writeApa102Frame(const uint32_t *pixels, int pixelCount) {
+        int frameLength = APA102_FRAME_SIZE(pixelCount);
+        bool fits = length == 0 && frameLength <= bufferSize;
+
+        if (fits) {
+            auto words = reinterpret_cast<uint32_t *>(buffer);
+            words[0] = 0;
+            for (int i = 0; i < pixelCount; ++i)
+                words[i + 1] = pixels[i];
+            memset(buffer + 4 + 4 * pixelCount, 0, frameLength - 4 - 4 * pixelCount);
+        }
+        length += frameLength;
+
+        return fits;
+    }
+};
+
+#endif //LED_FAN_SPIFRAMEWRITER_H
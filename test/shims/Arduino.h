@@ -0,0 +1,12 @@
+#ifndef LED_FAN_SHIM_ARDUINO_H
+#define LED_FAN_SHIM_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core the tested sources use
+
+#include <esp32-hal.h>
+#include <WString.h>
+
+#define _min(a, b) ((a) < (b) ? (a) : (b))
+#define _max(a, b) ((a) > (b) ? (a) : (b))
+
+#endif //LED_FAN_SHIM_ARDUINO_H
@@ -0,0 +1,6 @@
+#ifndef LED_FAN_SHIM_HARDWARESERIAL_H
+#define LED_FAN_SHIM_HARDWARESERIAL_H
+
+// Nothing the tested sources use
+
+#endif //LED_FAN_SHIM_HARDWARESERIAL_H
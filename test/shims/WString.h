@@ -0,0 +1,55 @@
+#ifndef LED_FAN_SHIM_WSTRING_H
+#define LED_FAN_SHIM_WSTRING_H
+
+// Host stand-in for Arduino's String, as far as the tested sources use it
+
+#include <cstdlib>
+#include <string>
+
+class String : public std::string {
+public:
+    String() = default;
+    String(const char *value) : std::string(value) {}
+    String(const std::string &value) : std::string(value) {}
+    explicit String(char value) : std::string(1, value) {}
+    explicit String(int value) : std::string(std::to_string(value)) {}
+    explicit String(unsigned int value) : std::string(std::to_string(value)) {}
+    explicit String(long value) : std::string(std::to_string(value)) {}
+    explicit String(unsigned long value) : std::string(std::to_string(value)) {}
+    explicit String(float value) : std::string(std::to_string(value)) {}
+    explicit String(double value) : std::string(std::to_string(value)) {}
+
+    // Arduino's returns the raw buffer
+    char *begin() {
+        return &(*this)[0];
+    }
+
+    long toInt() const {
+        return strtol(c_str(), nullptr, 10);
+    }
+
+    bool startsWith(const String &prefix) const {
+        return compare(0, prefix.length(), prefix) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        auto index = find(c, from);
+        return index == npos ? -1 : int(index);
+    }
+
+    String substring(unsigned int from, unsigned int to) const {
+        return String(substr(from, to - from));
+    }
+
+    void trim() {
+        auto first = find_first_not_of(" \t\r\n");
+        auto last = find_last_not_of(" \t\r\n");
+        *this = first == npos ? String() : String(substr(first, last - first + 1));
+    }
+
+    String operator+(const String &other) const {
+        return String(std::string(*this) + std::string(other));
+    }
+};
+
+#endif //LED_FAN_SHIM_WSTRING_H
@@ -0,0 +1,27 @@
+#ifndef LED_FAN_SHIM_SPI_COMMON_H
+#define LED_FAN_SHIM_SPI_COMMON_H
+
+// Host stand-in for the ESP-IDF SPI types. There is no bus on the host;
+// tests provide their own SPIDMAQueue.
+
+#include <cstdint>
+#include <esp_err.h>
+
+typedef enum {
+    SPI_HOST = 0,
+    HSPI_HOST = 1,
+    VSPI_HOST = 2
+} spi_host_device_t;
+
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+    int max_transfer_sz;
+    uint32_t flags;
+    int intr_flags;
+} spi_bus_config_t;
+
+#endif //LED_FAN_SHIM_SPI_COMMON_H
@@ -0,0 +1,29 @@
+#ifndef LED_FAN_SHIM_SPI_MASTER_H
+#define LED_FAN_SHIM_SPI_MASTER_H
+
+#include <cstddef>
+#include "spi_common.h"
+
+typedef struct spi_device_t *spi_device_handle_t;
+
+typedef struct {
+    uint8_t command_bits;
+    uint8_t address_bits;
+    uint8_t dummy_bits;
+    uint8_t mode;
+    int clock_speed_hz;
+    int spics_io_num;
+    uint32_t flags;
+    int queue_size;
+} spi_device_interface_config_t;
+
+typedef struct {
+    uint32_t flags;
+    size_t length;
+    size_t rxlength;
+    void *user;
+    const void *tx_buffer;
+    void *rx_buffer;
+} spi_transaction_t;
+
+#endif //LED_FAN_SHIM_SPI_MASTER_H
@@ -0,0 +1,17 @@
+#ifndef LED_FAN_SHIM_ESP32_HAL_H
+#define LED_FAN_SHIM_ESP32_HAL_H
+
+// Host stand-in for the parts of the Arduino core the tested sources use
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <freertos/FreeRTOS.h>
+
+inline unsigned long micros() {
+    using namespace std::chrono;
+    return (unsigned long) duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#endif //LED_FAN_SHIM_ESP32_HAL_H
@@ -0,0 +1,8 @@
+#ifndef LED_FAN_SHIM_ESP_ERR_H
+#define LED_FAN_SHIM_ESP_ERR_H
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERROR_CHECK(x) ((void) (x))
+
+#endif //LED_FAN_SHIM_ESP_ERR_H
@@ -0,0 +1,16 @@
+#ifndef LED_FAN_SHIM_ESP_LOG_H
+#define LED_FAN_SHIM_ESP_LOG_H
+
+// Logs go nowhere on the host
+
+#include <cstdarg>
+
+#define ESP_LOG_INFO 3
+#define ESP_LOGI(tag, format, ...) esp_log_discard(tag, format, ##__VA_ARGS__)
+
+template <typename... Args>
+inline void esp_log_discard(const char *, const char *, Args...) {}
+
+inline void esp_log_level_set(const char *, int) {}
+
+#endif //LED_FAN_SHIM_ESP_LOG_H
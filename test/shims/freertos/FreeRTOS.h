@@ -0,0 +1,20 @@
+#ifndef LED_FAN_SHIM_FREERTOS_H
+#define LED_FAN_SHIM_FREERTOS_H
+
+// Host stand-in for FreeRTOS. Host tests run on a single thread,
+// so critical sections do nothing.
+
+#include <cstdint>
+#include <cstring>
+
+typedef uint32_t TickType_t;
+#define portMAX_DELAY ((TickType_t) 0xffffffff)
+
+typedef struct {
+    uint32_t owner;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) ((void) (mux))
+#define portEXIT_CRITICAL(mux) ((void) (mux))
+
+#endif //LED_FAN_SHIM_FREERTOS_H
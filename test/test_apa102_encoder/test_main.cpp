@@ -0,0 +1,146 @@
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <screen/Apa102Encoder.h>
+
+static const uint32_t _255e3 = 255 * 255 * 255;
+static const uint32_t _255e4 = _255e3 * 255;
+
+// The division based encoding the encoder replaced
+static uint8_t referenceBrightness(uint32_t peakBrightness) {
+    return uint8_t((peakBrightness - 1) / 255 * 31 / _255e3 + 1);
+}
+
+static uint32_t referenceRescaler(uint32_t brightness) {
+    return _255e3 * brightness / 31;
+}
+
+__attribute__((noinline)) static void referenceEncode(const uint32_t *input, Apa102Color *output, size_t count) {
+    for (size_t i = 0; i < count; ++i, input += 3) {
+        uint32_t peakBrightness = std::max(std::max(input[0], input[1]), input[2]);
+        if (peakBrightness == 0) {
+            output[i] = Apa102Color { 0xff, 0, 0, 0 };
+            continue;
+        }
+
+        uint8_t brightness = referenceBrightness(peakBrightness);
+        uint32_t rescaler = referenceRescaler(brightness);
+
+        output[i] = Apa102Color {
+            uint8_t(0b11100000 | brightness),
+            uint8_t(std::min(input[2] / rescaler, uint32_t(255))),
+            uint8_t(std::min(input[1] / rescaler, uint32_t(255))),
+            uint8_t(std::min(input[0] / rescaler, uint32_t(255)))
+        };
+    }
+}
+
+__attribute__((noinline)) static void encode(const uint32_t *input, Apa102Color *output, size_t count) {
+    for (size_t i = 0; i < count; ++i, input += 3)
+        output[i] = Apa102Encoder::encode(input[0], input[1], input[2]);
+}
+
+static std::vector<uint32_t> randomComponents(size_t count) {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<uint32_t> distribution(0, _255e4);
+
+    std::vector<uint32_t> components(count);
+    for (auto &component : components)
+        component = distribution(random);
+
+    return components;
+}
+
+void setUp() {
+    Apa102Encoder::initTables();
+}
+
+void tearDown() {}
+
+void test_tables_match_division() {
+    for (uint32_t brightness = 1; brightness <= 31; ++brightness) {
+        TEST_ASSERT_EQUAL_UINT32(referenceRescaler(brightness), Apa102Encoder::rescalers[brightness]);
+        TEST_ASSERT_EQUAL_UINT32(brightness, referenceBrightness(Apa102Encoder::brightnessStarts[brightness]));
+        if (brightness > 1)
+            TEST_ASSERT_EQUAL_UINT32(brightness - 1, referenceBrightness(Apa102Encoder::brightnessStarts[brightness] - 1));
+    }
+}
+
+void test_global_brightness_exhaustive() {
+    uint32_t mismatches = 0;
+    for (uint32_t peak = 1; peak <= _255e4; ++peak)
+        mismatches += Apa102Encoder::globalBrightness(peak) != referenceBrightness(peak);
+
+    TEST_ASSERT_EQUAL_UINT32(0, mismatches);
+}
+
+void test_divide_exhaustive() {
+    // The estimate never decreases with the value. So within each quotient
+    // step, it is lowest at the first value and highest at the last.
+    // If both ends come out exact, the estimate is at most one too low
+    // for every value in between, which the correction fixes.
+    for (uint32_t brightness = 1; brightness <= 31; ++brightness) {
+        uint32_t rescaler = Apa102Encoder::rescalers[brightness];
+        uint32_t reciprocal = Apa102Encoder::reciprocals[brightness];
+
+        for (uint64_t first = 0; first <= _255e4; first += rescaler) {
+            uint32_t last = uint32_t(std::min(first + rescaler - 1, uint64_t(_255e4)));
+            uint32_t quotient = uint32_t(first / rescaler);
+
+            TEST_ASSERT_EQUAL_UINT32(quotient, Apa102Encoder::divide(uint32_t(first), rescaler, reciprocal));
+            TEST_ASSERT_EQUAL_UINT32(quotient, Apa102Encoder::divide(last, rescaler, reciprocal));
+        }
+    }
+}
+
+void test_encode_matches_division() {
+    const size_t count = 1 << 20;
+    auto input = randomComponents(count * 3);
+    // Make sure every global brightness step is hit right at its edge
+    for (uint32_t brightness = 1; brightness <= 31; ++brightness) {
+        input[brightness * 3] = Apa102Encoder::brightnessStarts[brightness];
+        input[brightness * 3 + 1] = Apa102Encoder::brightnessStarts[brightness] - 1;
+        input[brightness * 3 + 2] = 0;
+    }
+
+    std::vector<Apa102Color> expected(count), actual(count);
+    referenceEncode(input.data(), expected.data(), count);
+    encode(input.data(), actual.data(), count);
+
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), actual.data(), count * sizeof(Apa102Color));
+}
+
+void benchmark_encode() {
+    const size_t count = 1 << 16;
+    const int rounds = 100;
+    auto input = randomComponents(count * 3);
+    std::vector<Apa102Color> output(count);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+        referenceEncode(input.data(), output.data(), count);
+    auto middle = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+        encode(input.data(), output.data(), count);
+    auto end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::nano> divided = middle - start, multiplied = end - middle;
+
+    char message[96];
+    snprintf(message, sizeof(message), "division: %.2f ns / pixel, reciprocals: %.2f ns / pixel",
+             divided.count() / rounds / count, multiplied.count() / rounds / count);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_tables_match_division);
+    RUN_TEST(test_global_brightness_exhaustive);
+    RUN_TEST(test_divide_exhaustive);
+    RUN_TEST(test_encode_matches_division);
+    RUN_TEST(benchmark_encode);
+    return UNITY_END();
+}
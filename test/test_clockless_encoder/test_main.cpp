@@ -0,0 +1,113 @@
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include <screen/ClocklessSPIEncoder.h>
+
+// WS2812B timing limits, in ns
+static const int T0H_MIN = 250, T0H_MAX = 550;
+static const int T1H_MIN = 650, T1H_MAX = 950;
+static const int T0L_MIN = 700, T0L_MAX = 1000;
+static const int T1L_MIN = 300, T1L_MAX = 600;
+static const int RESET_MIN = 280 * 1000;
+
+static const int NANOS_PER_SPI_BIT = 1000 * 1000 * 1000 / ClocklessSPIEncoder::clockSpeedHz;
+
+static ClocklessSPIEncoder encoder;
+
+static bool spiBit(const uint8_t *stream, size_t index) {
+    return (stream[index / 8] >> (7 - index % 8)) & 1;
+}
+
+// Decodes one data bit from its SPI bits, checking the waveform on the way
+static int decodeBit(const uint8_t *stream, size_t bit) {
+    size_t first = bit * ClocklessSPIEncoder::bitsPerBit;
+    size_t end = first + ClocklessSPIEncoder::bitsPerBit;
+
+    // High, then low, and nothing else
+    size_t high = first;
+    while (high < end && spiBit(stream, high))
+        ++high;
+    for (size_t i = high; i < end; ++i)
+        TEST_ASSERT_FALSE(spiBit(stream, i));
+
+    int highNanos = int(high - first) * NANOS_PER_SPI_BIT;
+    int lowNanos = int(end - high) * NANOS_PER_SPI_BIT;
+
+    if (highNanos >= T1H_MIN && highNanos <= T1H_MAX) {
+        TEST_ASSERT_TRUE(lowNanos >= T1L_MIN && lowNanos <= T1L_MAX);
+        return 1;
+    }
+
+    TEST_ASSERT_TRUE(highNanos >= T0H_MIN && highNanos <= T0H_MAX);
+    TEST_ASSERT_TRUE(lowNanos >= T0L_MIN && lowNanos <= T0L_MAX);
+    return 0;
+}
+
+static uint8_t decodeByte(const uint8_t *stream, size_t byte) {
+    uint8_t value = 0;
+    for (size_t bit = byte * 8; bit < byte * 8 + 8; ++bit)
+        value = uint8_t(value << 1 | decodeBit(stream, bit));
+
+    return value;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_every_byte_decodes_within_timing() {
+    uint8_t stream[ClocklessSPIEncoder::bitsPerBit];
+
+    for (uint32_t value = 0; value < 256; ++value) {
+        encoder.encode(uint8_t(value), stream);
+        TEST_ASSERT_EQUAL_UINT8(value, decodeByte(stream, 0));
+    }
+}
+
+void test_pixels_are_sent_in_grb() {
+    uint8_t stream[ClocklessSPIEncoder::bytesPerPixel];
+
+    for (uint32_t value = 0; value < 256; ++value) {
+        uint8_t r = uint8_t(value), g = uint8_t(255 - value), b = uint8_t(value ^ 0x5a);
+        encoder.encodePixel(r, g, b, stream);
+
+        TEST_ASSERT_EQUAL_UINT8(g, decodeByte(stream, 0));
+        TEST_ASSERT_EQUAL_UINT8(r, decodeByte(stream, 1));
+        TEST_ASSERT_EQUAL_UINT8(b, decodeByte(stream, 2));
+    }
+}
+
+void test_reset_latches() {
+    TEST_ASSERT_GREATER_OR_EQUAL(RESET_MIN, int(ClocklessSPIEncoder::resetBytes) * 8 * NANOS_PER_SPI_BIT);
+}
+
+void benchmark_encode_pixels() {
+    const size_t pixelCount = 1024;
+    const int rounds = 10000;
+    std::vector<uint8_t> stream(pixelCount * ClocklessSPIEncoder::bytesPerPixel);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (size_t p = 0; p < pixelCount; ++p) {
+            encoder.encodePixel(uint8_t(p), uint8_t(p >> 2), uint8_t(round),
+                                stream.data() + p * ClocklessSPIEncoder::bytesPerPixel);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    // For comparison, the wire takes 28.8µs per pixel
+    char message[64];
+    snprintf(message, sizeof(message), "%.2f ns / pixel (checksum %d)",
+             elapsed.count() / rounds / pixelCount, stream[pixelCount / 2]);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_every_byte_decodes_within_timing);
+    RUN_TEST(test_pixels_are_sent_in_grb);
+    RUN_TEST(test_reset_latches);
+    RUN_TEST(benchmark_encode_pixels);
+    return UNITY_END();
+}
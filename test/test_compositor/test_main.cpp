@@ -0,0 +1,180 @@
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <screen/Compositor.h>
+
+static const size_t PIXEL_COUNT = 1024;
+
+static void fillRandom(PRGB *pixels, size_t count, uint32_t seed) {
+    std::mt19937 random(seed);
+    auto components = reinterpret_cast<uint8_t *>(pixels);
+    for (size_t i = 0; i < count * 3; ++i)
+        components[i] = uint8_t(random());
+}
+
+// One component through the layer stack, spelled out
+static int referenceBlend(int value, const Compositor &compositor, size_t component) {
+    for (auto &layer : compositor.layers) {
+        if (!layer.pixels || layer.opacity == 0)
+            continue;
+
+        int top = reinterpret_cast<const uint8_t *>(layer.pixels)[component];
+        switch (layer.mode) {
+            case Compositor::normal:
+                value += (top - value) * layer.opacity / 255;
+                break;
+            case Compositor::add:
+                value = std::min(value + top * layer.opacity / 255, 255);
+                break;
+            case Compositor::multiply:
+                value += (value * top / 255 - value) * layer.opacity / 255;
+                break;
+            case Compositor::max:
+                value += (std::max(value, top) - value) * layer.opacity / 255;
+                break;
+        }
+    }
+
+    return value;
+}
+
+// One layer per blend mode, each at some other opacity
+static void stackLayers(Compositor &compositor) {
+    const Compositor::BlendMode modes[] = {
+        Compositor::normal, Compositor::add, Compositor::multiply, Compositor::max
+    };
+
+    for (size_t i = 0; i < Compositor::maxLayers; ++i) {
+        fillRandom(compositor.layer(i)->pixels, PIXEL_COUNT, uint32_t(i + 1));
+        compositor.setBlendMode(i, modes[i]);
+        compositor.setOpacity(i, uint8_t(64 + i * 60));
+    }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_layers_blend_over_base() {
+    Renderer renderer(PIXEL_COUNT, 0);
+    Compositor compositor(PIXEL_COUNT);
+    stackLayers(compositor);
+
+    std::vector<PRGB> base(PIXEL_COUNT);
+    fillRandom(base.data(), PIXEL_COUNT, 0);
+    compositor.composite(base.data(), &renderer);
+
+    auto baseComponents = reinterpret_cast<const uint8_t *>(base.data());
+    auto output = reinterpret_cast<const uint8_t *>(compositor.output);
+    for (size_t i = 0; i < PIXEL_COUNT * 3; ++i)
+        TEST_ASSERT_EQUAL_INT(referenceBlend(baseComponents[i], compositor, i), output[i]);
+
+    // Topology's black pixel stays black
+    TEST_ASSERT_EQUAL_UINT8(0, compositor.output[PIXEL_COUNT].r);
+}
+
+void test_without_layers_shows_base() {
+    Renderer renderer(PIXEL_COUNT, 0);
+    Compositor compositor(PIXEL_COUNT);
+    // New layers are hidden
+    compositor.layer(0);
+
+    std::vector<PRGB> base(PIXEL_COUNT);
+    fillRandom(base.data(), PIXEL_COUNT, 0);
+    compositor.composite(base.data(), &renderer);
+
+    TEST_ASSERT_EQUAL_MEMORY(base.data(), compositor.output, PIXEL_COUNT * sizeof(PRGB));
+}
+
+void test_16_bit_base_matches_8_bit() {
+    Renderer renderer(PIXEL_COUNT, 0);
+    Compositor compositor(PIXEL_COUNT);
+    stackLayers(compositor);
+
+    std::vector<PRGB> base(PIXEL_COUNT);
+    fillRandom(base.data(), PIXEL_COUNT, 0);
+    std::vector<PRGB16> base16(base.begin(), base.end());
+
+    compositor.composite(base.data(), &renderer);
+    compositor.composite(base16.data(), &renderer);
+
+    // Each layer may round differently, by less than one 8 bit step
+    auto output = reinterpret_cast<const uint8_t *>(compositor.output);
+    auto output16 = reinterpret_cast<const uint16_t *>(compositor.getOutput16());
+    for (size_t i = 0; i < PIXEL_COUNT * 3; ++i)
+        TEST_ASSERT_INT_WITHIN(257 * int(Compositor::maxLayers), output[i] * 257, output16[i]);
+}
+
+void test_only_changes_are_composited() {
+    Renderer renderer(PIXEL_COUNT, 0);
+    Compositor compositor(PIXEL_COUNT);
+    std::vector<PRGB> base(PIXEL_COUNT, PRGB(PRGB::black));
+
+    // Black adds nothing, so the base shows through
+    auto layer = compositor.layer(0);
+    compositor.setOpacity(0, 255);
+    compositor.setBlendMode(0, Compositor::add);
+    compositor.composite(base.data(), &renderer);
+    renderer.render();
+
+    // Nothing changed
+    auto composites = compositor.compositeTimeHistory->head;
+    compositor.composite(base.data(), &renderer);
+    TEST_ASSERT_FALSE(renderer.isDirty());
+    TEST_ASSERT_EQUAL_UINT32(composites, compositor.compositeTimeHistory->head);
+
+    PRGB(PRGB::white).fill(layer->pixels + 10, 10);
+    layer->setDirty(10, 20);
+    base[100] = PRGB(PRGB::red);
+    compositor.setBaseDirty(100, 101);
+    compositor.composite(base.data(), &renderer);
+
+    TEST_ASSERT_EQUAL_UINT32(10, renderer.dirtyStart());
+    TEST_ASSERT_EQUAL_UINT32(101, renderer.dirtyEnd());
+    TEST_ASSERT_EQUAL_UINT8(255, compositor.output[15].g);
+    TEST_ASSERT_EQUAL_UINT8(255, compositor.output[100].r);
+}
+
+void benchmark_composite() {
+    const int rounds = 2000;
+    Renderer renderer(PIXEL_COUNT, 0);
+    Compositor compositor(PIXEL_COUNT);
+    stackLayers(compositor);
+
+    std::vector<PRGB> base(PIXEL_COUNT);
+    fillRandom(base.data(), PIXEL_COUNT, 0);
+    std::vector<PRGB16> base16(base.begin(), base.end());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        compositor.setBaseDirty(0, PIXEL_COUNT);
+        compositor.composite(base.data(), &renderer);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        compositor.setBaseDirty(0, PIXEL_COUNT);
+        compositor.composite(base16.data(), &renderer);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::nano> time8 = middle - start, time16 = end - middle;
+
+    char message[96];
+    snprintf(message, sizeof(message), "4 layers, 8 bit: %.2f ns / pixel, 16 bit: %.2f ns / pixel",
+             time8.count() / rounds / PIXEL_COUNT, time16.count() / rounds / PIXEL_COUNT);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_layers_blend_over_base);
+    RUN_TEST(test_without_layers_shows_base);
+    RUN_TEST(test_16_bit_base_matches_8_bit);
+    RUN_TEST(test_only_changes_are_composited);
+    RUN_TEST(benchmark_composite);
+    return UNITY_END();
+}
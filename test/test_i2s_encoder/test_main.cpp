@@ -0,0 +1,130 @@
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <screen/I2SParallelEncoder.h>
+
+static const uint16_t ALL_LANES = 0xff;
+
+// Bit by bit, the way transpose8 is specified
+__attribute__((noinline)) static void referenceTranspose8(const uint8_t *in, uint8_t *out) {
+    for (int k = 0; k < 8; ++k) {
+        uint8_t row = 0;
+        for (int j = 0; j < 8; ++j)
+            row |= uint8_t(((in[j] >> (7 - k)) & 1) << j);
+        out[k] = row;
+    }
+}
+
+__attribute__((noinline)) static void referenceEncodePixel(const uint8_t *componentLanes, uint16_t laneMask, uint16_t *slots) {
+    size_t s = 0;
+    for (size_t c = 0; c < 3; ++c) {
+        for (int bit = 7; bit >= 0; --bit) {
+            uint16_t data = 0;
+            for (int lane = 0; lane < 8; ++lane)
+                data |= uint16_t(((componentLanes[c * 8 + lane] >> bit) & 1) << lane);
+
+            // Halves of each 32 bit word are sent swapped
+            slots[(s++) ^ 1] = laneMask;
+            slots[(s++) ^ 1] = data;
+            slots[(s++) ^ 1] = 0;
+        }
+    }
+}
+
+__attribute__((noinline)) static void encodePixels(const uint8_t *componentLanes, uint16_t *slots, size_t count) {
+    for (size_t p = 0; p < count; ++p)
+        I2SParallelEncoder::encodePixel(componentLanes + p * 24, ALL_LANES, slots + p * I2SParallelEncoder::slotsPerPixel);
+}
+
+__attribute__((noinline)) static void referenceEncodePixels(const uint8_t *componentLanes, uint16_t *slots, size_t count) {
+    for (size_t p = 0; p < count; ++p)
+        referenceEncodePixel(componentLanes + p * 24, ALL_LANES, slots + p * I2SParallelEncoder::slotsPerPixel);
+}
+
+static std::vector<uint8_t> randomBytes(size_t count) {
+    std::mt19937 random(1);
+    std::vector<uint8_t> bytes(count);
+    for (auto &byte : bytes)
+        byte = uint8_t(random());
+
+    return bytes;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_transpose_single_bits() {
+    // Each input bit lands in exactly one place
+    for (int j = 0; j < 8; ++j) {
+        for (int bit = 0; bit < 8; ++bit) {
+            uint8_t in[8] = {0}, expected[8], actual[8];
+            in[j] = uint8_t(1 << bit);
+            referenceTranspose8(in, expected);
+            BitTranspose::transpose8(in, actual);
+
+            TEST_ASSERT_EQUAL_MEMORY(expected, actual, 8);
+        }
+    }
+}
+
+void test_transpose_matches_reference() {
+    const size_t count = 1 << 16;
+    auto input = randomBytes(count * 8);
+
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t expected[8], actual[8];
+        referenceTranspose8(input.data() + i * 8, expected);
+        BitTranspose::transpose8(input.data() + i * 8, actual);
+
+        TEST_ASSERT_EQUAL_MEMORY(expected, actual, 8);
+    }
+}
+
+void test_encode_matches_reference() {
+    const size_t count = 4096;
+    auto input = randomBytes(count * 24);
+    std::vector<uint16_t> expected(count * I2SParallelEncoder::slotsPerPixel);
+    std::vector<uint16_t> actual(expected.size());
+
+    referenceEncodePixels(input.data(), expected.data(), count);
+    encodePixels(input.data(), actual.data(), count);
+
+    TEST_ASSERT_EQUAL_MEMORY(expected.data(), actual.data(), expected.size() * sizeof(uint16_t));
+}
+
+void benchmark_encode() {
+    const size_t count = 1024;
+    const int rounds = 2000;
+    auto input = randomBytes(count * 24);
+    std::vector<uint16_t> slots(count * I2SParallelEncoder::slotsPerPixel);
+
+    encodePixels(input.data(), slots.data(), count);
+    referenceEncodePixels(input.data(), slots.data(), count);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+        referenceEncodePixels(input.data(), slots.data(), count);
+    auto middle = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+        encodePixels(input.data(), slots.data(), count);
+    auto end = std::chrono::steady_clock::now();
+
+    // Each encoded pixel covers one LED on each of the 8 lanes
+    std::chrono::duration<double, std::nano> naive = middle - start, transposed = end - middle;
+    char message[96];
+    snprintf(message, sizeof(message), "per bit: %.2f ns / LED, transposed: %.2f ns / LED",
+             naive.count() / rounds / count / 8, transposed.count() / rounds / count / 8);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_transpose_single_bits);
+    RUN_TEST(test_transpose_matches_reference);
+    RUN_TEST(test_encode_matches_reference);
+    RUN_TEST(benchmark_encode);
+    return UNITY_END();
+}
@@ -0,0 +1,178 @@
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <screen/Pixels.h>
+
+// The double based conversion PHSV used to do, with its bugs fixed:
+// v is scaled to 0..255, sector 5 is (v, p, q) and hue 255 wraps to red.
+// hue may have a fraction, like the ramp's 8.8 hues.
+__attribute__((noinline)) static void referenceToRGB(double hue, uint8_t saturation, uint8_t value, PRGB *rgb) {
+    double h = hue / 255.0 * 6.0, s = saturation / 255.0, v = value / 255.0;
+    if (h >= 6)
+        h -= 6;
+    double fract = h - floor(h);
+
+    double V = v * 255.0;
+    double P = v * (1. - s) * 255.0;
+    double Q = v * (1. - s * fract) * 255.0;
+    double T = v * (1. - s * (1. - fract)) * 255.0;
+
+    if (h < 1.)
+        *rgb = PRGB(V, T, P);
+    else if (h < 2.)
+        *rgb = PRGB(Q, V, P);
+    else if (h < 3.)
+        *rgb = PRGB(P, V, T);
+    else if (h < 4.)
+        *rgb = PRGB(P, Q, V);
+    else if (h < 5.)
+        *rgb = PRGB(T, P, V);
+    else
+        *rgb = PRGB(V, P, Q);
+}
+
+static void referenceToRGB(const PHSV &hsv, PRGB *rgb) {
+    referenceToRGB(hsv.h, hsv.s, hsv.v, rgb);
+}
+
+static std::vector<PHSV> sampleColors(size_t count) {
+    std::vector<PHSV> hsv(count);
+    for (size_t i = 0; i < count; ++i)
+        hsv[i] = PHSV(uint8_t(i * 7), uint8_t(200 + i % 50), uint8_t(i * 3));
+
+    return hsv;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_hsv_within_one_of_reference() {
+    int maxDifference = 0;
+    uint64_t exact = 0;
+
+    for (uint32_t h = 0; h < 256; ++h) {
+        for (uint32_t s = 0; s < 256; ++s) {
+            for (uint32_t v = 0; v < 256; ++v) {
+                PHSV hsv = PHSV(uint8_t(h), uint8_t(s), uint8_t(v));
+                PRGB expected, actual;
+                referenceToRGB(hsv, &expected);
+                hsv.toRGB(&actual);
+
+                for (int c = 0; c < 3; ++c) {
+                    int difference = abs(int(expected.components[c]) - int(actual.components[c]));
+                    maxDifference = std::max(maxDifference, difference);
+                    exact += difference == 0;
+                }
+            }
+        }
+    }
+
+    char message[64];
+    snprintf(message, sizeof(message), "%.2f%% of components exact", double(exact) / (3 << 24) * 100);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_LESS_OR_EQUAL(1, maxDifference);
+}
+
+void test_hue_wraps_to_red() {
+    PRGB rgb;
+    PHSV(255, 255, 255).toRGB(&rgb);
+
+    TEST_ASSERT_EQUAL_UINT8(255, rgb.r);
+    TEST_ASSERT_EQUAL_UINT8(0, rgb.g);
+    TEST_ASSERT_EQUAL_UINT8(0, rgb.b);
+}
+
+void test_batch_matches_single() {
+    const size_t count = 4096;
+    auto hsv = sampleColors(count);
+    std::vector<PRGB> batch(count);
+    PHSV::toRGB(hsv.data(), batch.data(), count);
+
+    for (size_t i = 0; i < count; ++i) {
+        PRGB single;
+        hsv[i].toRGB(&single);
+        TEST_ASSERT_EQUAL_MEMORY(&single, &batch[i], sizeof(PRGB));
+    }
+}
+
+void test_hue_ramp_matches_single() {
+    // Whole hues only, so 8 bit hues can match
+    const size_t count = 4096;
+    const uint16_t startHue = 100 << 8, hueStep = 37 << 8;
+    std::vector<PRGB> ramp(count);
+    PHSV::fillHueRamp(ramp.data(), count, startHue, hueStep, 200, 180);
+
+    uint16_t hue = startHue;
+    for (size_t i = 0; i < count; ++i, hue += hueStep) {
+        PRGB single;
+        PHSV(uint8_t(hue >> 8), 200, 180).toRGB(&single);
+        TEST_ASSERT_EQUAL_MEMORY(&single, &ramp[i], sizeof(PRGB));
+    }
+}
+
+void test_slow_hue_ramp_is_smooth() {
+    // A quarter hue per pixel; at full saturation and value, that's
+    // 1.5 steps of the changing component, once around the circle
+    const size_t count = 1024;
+    const uint16_t hueStep = 64;
+    std::vector<PRGB> ramp(count);
+    PHSV::fillHueRamp(ramp.data(), count, 0, hueStep, 255, 255);
+
+    for (size_t i = 0; i < count; ++i) {
+        PRGB expected;
+        referenceToRGB(double(i * hueStep) / 256, 255, 255, &expected);
+        for (int c = 0; c < 3; ++c)
+            TEST_ASSERT_INT_WITHIN(1, expected.components[c], ramp[i].components[c]);
+
+        // Dropping the fraction would repeat each color 4 times
+        if (i > 0)
+            TEST_ASSERT_FALSE(memcmp(&ramp[i - 1], &ramp[i], sizeof(PRGB)) == 0);
+    }
+}
+
+void benchmark_hsv() {
+    const size_t count = 4096;
+    const int rounds = 2000;
+    auto hsv = sampleColors(count);
+    std::vector<PRGB> rgb(count);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i < count; ++i)
+            referenceToRGB(hsv[i], &rgb[i]);
+    }
+    auto reference = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+        PHSV::toRGB(hsv.data(), rgb.data(), count);
+    auto batch = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round)
+        PHSV::fillHueRamp(rgb.data(), count, uint16_t(round), 37, 255, 255);
+    auto ramp = std::chrono::steady_clock::now();
+
+    auto nanosPerPixel = [&](std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+        return std::chrono::duration<double, std::nano>(to - from).count() / rounds / count;
+    };
+
+    char message[128];
+    snprintf(message, sizeof(message), "double: %.2f ns / pixel, batch: %.2f ns / pixel, ramp: %.2f ns / pixel",
+             nanosPerPixel(start, reference), nanosPerPixel(reference, batch), nanosPerPixel(batch, ramp));
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_hsv_within_one_of_reference);
+    RUN_TEST(test_hue_wraps_to_red);
+    RUN_TEST(test_batch_matches_single);
+    RUN_TEST(test_hue_ramp_matches_single);
+    RUN_TEST(test_slow_hue_ramp_is_smooth);
+    RUN_TEST(benchmark_hsv);
+    return UNITY_END();
+}
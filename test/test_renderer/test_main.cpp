@@ -0,0 +1,310 @@
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <screen/Apa102Renderer.h>
+#include <screen/StaticRenderer.h>
+#include <screen/Topology.h>
+
+static const size_t PIXEL_COUNT = 1024;
+static const int BENCHMARK_FRAMES = 500;
+
+static void fillRandom(Renderer *renderer, uint32_t seed) {
+    std::mt19937 random(seed);
+    auto components = reinterpret_cast<uint8_t *>(renderer->rgb);
+    for (size_t i = 0; i < renderer->pixelCount * 3; ++i)
+        components[i] = uint8_t(random());
+
+    renderer->setDirty();
+}
+
+// The buffer queued by the last render() call
+static const uint8_t *lastFrame(SPIDMAQueue *queue) {
+    auto transaction = queue->transactions[(queue->currentTransaction + queue->queueDepth - 1) % queue->queueDepth];
+    return reinterpret_cast<const uint8_t *>(transaction.tx_buffer);
+}
+
+static const uint8_t *lastFrame(Apa102Bus &bus) {
+    return lastFrame(bus.queue);
+}
+
+// Renders each frame with both kernels, and expects the same output
+static void assertKernelsMatch(float maxLightness) {
+    Apa102Renderer twoPass(PIXEL_COUNT, 0);
+    Apa102Renderer fused(PIXEL_COUNT, 0);
+    fused.setFusedKernel(true);
+
+    for (auto renderer : { &twoPass, &fused }) {
+        renderer->setBrightness(0.8f);
+        renderer->setResponse(2);
+        renderer->setMaxLightness(maxLightness);
+    }
+
+    for (uint32_t frame = 0; frame < 8; ++frame) {
+        fillRandom(&twoPass, frame);
+        fillRandom(&fused, frame);
+        TEST_ASSERT_TRUE(twoPass.render());
+        TEST_ASSERT_TRUE(fused.render());
+
+        TEST_ASSERT_EQUAL_MEMORY(lastFrame(twoPass.buses[0]), lastFrame(fused.buses[0]), twoPass.buses[0].bufferSize);
+    }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_fused_kernel_matches_two_pass() {
+    assertKernelsMatch(0);
+}
+
+void test_fused_kernel_matches_two_pass_power_limited() {
+    // Random frames come out at about a quarter of full lightness
+    // with the response above, so this always limits
+    assertKernelsMatch(PIXEL_COUNT * 3 * 0.15f);
+}
+
+static double nanosPerPixel(Renderer *renderer) {
+    fillRandom(renderer, 0);
+    renderer->render();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < BENCHMARK_FRAMES; ++frame) {
+        renderer->setDirty();
+        renderer->render();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() / BENCHMARK_FRAMES / renderer->pixelCount;
+}
+
+void benchmark_fused_kernel() {
+    Apa102Renderer twoPass(PIXEL_COUNT, 0);
+    Apa102Renderer fused(PIXEL_COUNT, 0);
+    fused.setFusedKernel(true);
+
+    char message[96];
+    snprintf(message, sizeof(message), "two pass: %.2f ns / pixel, fused: %.2f ns / pixel",
+             nanosPerPixel(&twoPass), nanosPerPixel(&fused));
+    TEST_MESSAGE(message);
+}
+
+void benchmark_dithering() {
+    Apa102Renderer twoPass(PIXEL_COUNT, 0);
+    Apa102Renderer fused(PIXEL_COUNT, 0);
+    fused.setFusedKernel(true);
+    twoPass.setDithering(true);
+    fused.setDithering(true);
+
+    char message[96];
+    snprintf(message, sizeof(message), "dithered two pass: %.2f ns / pixel, fused: %.2f ns / pixel",
+             nanosPerPixel(&twoPass), nanosPerPixel(&fused));
+    TEST_MESSAGE(message);
+}
+
+void test_dithering_averages_to_16_bit() {
+    // Over 256 frames, the carried error adds up to less than 2 / 256 of a step
+    const int frames = 256;
+
+    for (bool fusedKernel : { false, true }) {
+        Apa102Renderer renderer(PIXEL_COUNT, 0);
+        std::vector<PRGB16> rgb16(PIXEL_COUNT);
+        renderer.rgb16 = rgb16.data();
+        renderer.setFusedKernel(fusedKernel);
+        renderer.setDithering(true);
+        renderer.setBrightness(1);
+        renderer.setResponse(1);
+
+        // Dark enough that the 16 bit values fall between 8 bit steps
+        std::mt19937 random(0);
+        for (auto &pixel : rgb16)
+            pixel = PRGB16(uint16_t(random() % 4096), uint16_t(random() % 4096), uint16_t(random() % 4096));
+
+        std::vector<uint64_t> sums(PIXEL_COUNT * 3, 0);
+        // Per pixel; constant, since the peak is
+        std::vector<uint32_t> steps(PIXEL_COUNT);
+        for (int frame = 0; frame < frames; ++frame) {
+            renderer.setDirty();
+            TEST_ASSERT_TRUE(renderer.render());
+
+            auto colors = reinterpret_cast<const Apa102Color *>(lastFrame(renderer.buses[0]) + 4);
+            for (size_t i = 0; i < PIXEL_COUNT; ++i) {
+                steps[i] = Apa102Encoder::rescalers[colors[i].brightness & 0b11111];
+                sums[i * 3] += uint64_t(colors[i].red) * steps[i];
+                sums[i * 3 + 1] += uint64_t(colors[i].green) * steps[i];
+                sums[i * 3 + 2] += uint64_t(colors[i].blue) * steps[i];
+            }
+        }
+
+        for (size_t i = 0; i < PIXEL_COUNT * 3; ++i) {
+            // With a linear response at full brightness, the lookup is
+            // 255^2 per 8 bit step, interpolated like Renderer::_lookup16
+            uint32_t value = rgb16[i / 3].components[i % 3];
+            uint32_t target = (value / 257 * 65025 + 65025 * (value % 257) / 257) * 255;
+
+            TEST_ASSERT_UINT32_WITHIN(steps[i / 3] / 64, target, uint32_t(sums[i] / frames));
+        }
+    }
+}
+
+void test_16_bit_matches_8_bit() {
+    // c * 257 is exactly the 8 bit value c
+    for (bool fusedKernel : { false, true }) {
+        Apa102Renderer narrow(PIXEL_COUNT, 0);
+        Apa102Renderer wide(PIXEL_COUNT, 0);
+        std::vector<PRGB16> rgb16(PIXEL_COUNT);
+        wide.rgb16 = rgb16.data();
+
+        for (auto renderer : { &narrow, &wide }) {
+            renderer->setFusedKernel(fusedKernel);
+            renderer->setResponse(2);
+        }
+
+        fillRandom(&narrow, 0);
+        for (size_t i = 0; i < PIXEL_COUNT; ++i)
+            rgb16[i] = PRGB16(narrow.rgb[i]);
+        wide.setDirty();
+
+        TEST_ASSERT_TRUE(narrow.render());
+        TEST_ASSERT_TRUE(wide.render());
+        TEST_ASSERT_EQUAL_MEMORY(lastFrame(narrow.buses[0]), lastFrame(wide.buses[0]), narrow.buses[0].bufferSize);
+    }
+}
+
+void benchmark_16_bit_input() {
+    for (bool fusedKernel : { false, true }) {
+        Apa102Renderer narrow(PIXEL_COUNT, 0);
+        Apa102Renderer wide(PIXEL_COUNT, 0);
+        narrow.setFusedKernel(fusedKernel);
+        wide.setFusedKernel(fusedKernel);
+
+        std::vector<PRGB16> rgb16(PIXEL_COUNT);
+        std::mt19937 random(0);
+        for (auto &pixel : rgb16)
+            pixel = PRGB16(uint16_t(random()), uint16_t(random()), uint16_t(random()));
+        wide.rgb16 = rgb16.data();
+
+        char message[96];
+        snprintf(message, sizeof(message), "%s: 8 bit: %.2f ns / pixel, 16 bit: %.2f ns / pixel",
+                 fusedKernel ? "fused" : "two pass", nanosPerPixel(&narrow), nanosPerPixel(&wide));
+        TEST_MESSAGE(message);
+    }
+}
+
+void test_static_renderer_matches_runtime() {
+    for (float maxLightness : { 0.0f, PIXEL_COUNT * 3 * 0.15f }) {
+        Apa102Renderer runtime(PIXEL_COUNT, 0);
+        StaticRenderer<Apa102Output, BGROrder, PIXEL_COUNT, true> fixed(0, 1, 2);
+
+        for (Renderer *renderer : std::initializer_list<Renderer *> { &runtime, &fixed }) {
+            renderer->setResponse(2);
+            renderer->setMaxLightness(maxLightness);
+        }
+
+        for (uint32_t frame = 0; frame < 4; ++frame) {
+            fillRandom(&runtime, frame);
+            fillRandom(&fixed, frame);
+            TEST_ASSERT_TRUE(runtime.render());
+            TEST_ASSERT_TRUE(fixed.render());
+
+            TEST_ASSERT_EQUAL_size_t(runtime.buses[0].bufferSize, fixed.queue->bufferSize);
+            TEST_ASSERT_EQUAL_MEMORY(lastFrame(runtime.buses[0]), lastFrame(fixed.queue), fixed.queue->bufferSize);
+        }
+    }
+}
+
+void test_static_clockless_leaves_clock_pin() {
+    StaticRenderer<ClocklessOutput, GRBOrder, 16, false> clockless(0, 1, 2);
+    StaticRenderer<Apa102Output, BGROrder, 16, false> clocked(0, 1, 2);
+
+    TEST_ASSERT_EQUAL_INT(-1, clockless.queue->SPI_settings.buscfg.sclk_io_num);
+    TEST_ASSERT_EQUAL_INT(2, clocked.queue->SPI_settings.buscfg.sclk_io_num);
+}
+
+void benchmark_static_renderer() {
+    Apa102Renderer twoPass(PIXEL_COUNT, 0);
+    Apa102Renderer fused(PIXEL_COUNT, 0);
+    fused.setFusedKernel(true);
+    StaticRenderer<Apa102Output, BGROrder, PIXEL_COUNT, false> fixed(0, 1, 2);
+    StaticRenderer<Apa102Output, BGROrder, PIXEL_COUNT, true> fixedPowerLimited(0, 1, 2);
+
+    char message[160];
+    snprintf(message, sizeof(message),
+             "runtime two pass: %.2f, fused: %.2f, static: %.2f, static power limited: %.2f (ns / pixel)",
+             nanosPerPixel(&twoPass), nanosPerPixel(&fused),
+             nanosPerPixel(&fixed), nanosPerPixel(&fixedPowerLimited));
+    TEST_MESSAGE(message);
+}
+
+void test_topology_gather_serpentine() {
+    Topology *topology = Topology::parse("matrix 0 4 2 serpentine", 8);
+    TEST_ASSERT_NOT_NULL(topology);
+
+    // One extra black pixel for unmapped ones
+    std::vector<PRGB> logical(topology->logicalCount + 1);
+    for (size_t i = 0; i < topology->logicalCount; ++i)
+        logical[i] = PRGB(uint8_t(i), 0, 0);
+
+    std::vector<PRGB> physical(8);
+    topology->gather(logical.data(), physical.data());
+
+    const uint8_t expected[] = { 0, 1, 2, 3, 7, 6, 5, 4 };
+    for (size_t i = 0; i < 8; ++i)
+        TEST_ASSERT_EQUAL_UINT8(expected[i], physical[i].r);
+
+    delete topology;
+}
+
+template <typename Pixel>
+static double gatherNanosPerPixel(const Topology *topology) {
+    std::vector<Pixel> logical(topology->logicalCount + 1);
+    std::vector<Pixel> physical(topology->pixelCount);
+    topology->gather(logical.data(), physical.data());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < BENCHMARK_FRAMES; ++frame) {
+        // Vary the input, so the copies can't be hoisted
+        logical[frame % topology->logicalCount].r = uint8_t(frame);
+        topology->gather(logical.data(), physical.data());
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    TEST_ASSERT_EQUAL(logical[0].r, physical[0].r);
+    return elapsed.count() / BENCHMARK_FRAMES / topology->pixelCount;
+}
+
+void benchmark_topology_gather() {
+    // 32 x 32 = PIXEL_COUNT
+    Topology *strip = Topology::parse("strip 0 1024", PIXEL_COUNT);
+    Topology *matrix = Topology::parse("matrix 0 32 32 serpentine", PIXEL_COUNT);
+    TEST_ASSERT_NOT_NULL(strip);
+    TEST_ASSERT_NOT_NULL(matrix);
+
+    char message[160];
+    snprintf(message, sizeof(message),
+             "strip: %.2f, serpentine matrix: %.2f, 16 bit strip: %.2f, 16 bit serpentine matrix: %.2f (ns / pixel)",
+             gatherNanosPerPixel<PRGB>(strip), gatherNanosPerPixel<PRGB>(matrix),
+             gatherNanosPerPixel<PRGB16>(strip), gatherNanosPerPixel<PRGB16>(matrix));
+    TEST_MESSAGE(message);
+
+    delete strip;
+    delete matrix;
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fused_kernel_matches_two_pass);
+    RUN_TEST(test_fused_kernel_matches_two_pass_power_limited);
+    RUN_TEST(benchmark_fused_kernel);
+    RUN_TEST(test_dithering_averages_to_16_bit);
+    RUN_TEST(benchmark_dithering);
+    RUN_TEST(test_16_bit_matches_8_bit);
+    RUN_TEST(benchmark_16_bit_input);
+    RUN_TEST(test_static_renderer_matches_runtime);
+    RUN_TEST(test_static_clockless_leaves_clock_pin);
+    RUN_TEST(benchmark_static_renderer);
+    RUN_TEST(test_topology_gather_serpentine);
+    RUN_TEST(benchmark_topology_gather);
+    return UNITY_END();
+}
@@ -0,0 +1,223 @@
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <util/spi/SPIFrameWriter.h>
+
+static const int LED_COUNT = 1024;
+// Start frame, one word per LED, end frame
+static const int FRAME_SIZE = APA102_FRAME_SIZE(LED_COUNT);
+static const uint8_t CANARY = 0xa5;
+
+// Writes an APA102 frame the way FastLED's controller does, byte by byte
+template <typename Writer>
+__attribute__((noinline)) static void writeFrame(Writer &writer, const uint8_t *pixels) {
+    writer.begin();
+    writer.writeWord(0);
+    writer.writeWord(0);
+    for (int i = 0; i < LED_COUNT * 4; i += 4) {
+        writer.writeByte(pixels[i]);
+        writer.writeByte(pixels[i + 1]);
+        writer.writeByte(pixels[i + 2]);
+        writer.writeByte(pixels[i + 3]);
+    }
+    for (int i = 0; i < LED_COUNT; i += 16)
+        writer.writeByte(0);
+}
+
+// Writes the same frame from one prepared word per LED, like ESP32Apa102Controller
+__attribute__((noinline)) static void writeBlockFrame(SPIFrameWriter &writer, const uint32_t *words) {
+    writer.begin();
+    writer.writeApa102Frame(words, LED_COUNT);
+}
+
+// SPIFrameWriter without the bounds checks, as ESP32SPI used to write.
+// Stores in the same order, so only the checks differ.
+struct UncheckedWriter {
+    uint8_t *buffer;
+    int length = 0;
+
+    void begin() {
+        length = 0;
+    }
+
+    void inline writeByte(uint8_t b) __attribute__((always_inline)) {
+        buffer[length] = b;
+        ++length;
+    }
+
+    void inline writeWord(uint16_t w) __attribute__((always_inline)) {
+        buffer[length] = uint8_t(w >> 8);
+        buffer[length + 1] = uint8_t(w);
+        length += 2;
+    }
+};
+
+static std::vector<uint8_t> pixels() {
+    std::vector<uint8_t> pixels(LED_COUNT * 4);
+    for (size_t i = 0; i < pixels.size(); ++i)
+        pixels[i] = uint8_t(i * 7 + 1);
+
+    return pixels;
+}
+
+// The same bytes, as words
+static std::vector<uint32_t> words(const std::vector<uint8_t> &pixels) {
+    std::vector<uint32_t> words(pixels.size() / 4);
+    memcpy(words.data(), pixels.data(), pixels.size());
+    return words;
+}
+
+// Word aligned, as DMA buffers are
+static std::vector<uint32_t> wordBuffer(int size, uint8_t fill) {
+    std::vector<uint32_t> buffer((size + 3) / 4);
+    memset(buffer.data(), fill, buffer.size() * 4);
+    return buffer;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_frame_fits_exactly() {
+    auto input = pixels();
+    std::vector<uint8_t> buffer(FRAME_SIZE + 1, CANARY);
+    SPIFrameWriter writer(FRAME_SIZE);
+    writer.buffer = buffer.data();
+
+    writeFrame(writer, input.data());
+
+    TEST_ASSERT_FALSE(writer.isOverrun());
+    TEST_ASSERT_EQUAL_INT(FRAME_SIZE, writer.length);
+    TEST_ASSERT_EQUAL_INT(0, writer.available());
+    TEST_ASSERT_EQUAL_MEMORY(input.data(), buffer.data() + 4, input.size());
+    TEST_ASSERT_EQUAL_UINT8(CANARY, buffer[FRAME_SIZE]);
+}
+
+void test_overrun_never_writes_past_buffer() {
+    auto input = pixels();
+    const int bufferSize = FRAME_SIZE / 2 + 1;
+    std::vector<uint8_t> buffer(FRAME_SIZE, CANARY);
+    SPIFrameWriter writer(bufferSize);
+    writer.buffer = buffer.data();
+
+    writeFrame(writer, input.data());
+
+    TEST_ASSERT_TRUE(writer.isOverrun());
+    TEST_ASSERT_EQUAL_INT(FRAME_SIZE, writer.length);
+    for (int i = bufferSize; i < FRAME_SIZE; ++i)
+        TEST_ASSERT_EQUAL_UINT8(CANARY, buffer[i]);
+
+    // The next frame starts over
+    writer.begin();
+    TEST_ASSERT_FALSE(writer.isOverrun());
+}
+
+void test_word_is_most_significant_byte_first() {
+    uint8_t buffer[3] = { CANARY, CANARY, CANARY };
+    SPIFrameWriter writer(3);
+    writer.buffer = buffer;
+
+    writer.writeWord(0x1234);
+    // Only one byte left; the word is dropped whole
+    writer.writeWord(0x5678);
+
+    TEST_ASSERT_EQUAL_UINT8(0x12, buffer[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x34, buffer[1]);
+    TEST_ASSERT_EQUAL_UINT8(CANARY, buffer[2]);
+    TEST_ASSERT_TRUE(writer.isOverrun());
+}
+
+void test_block_frame_matches_per_byte() {
+    auto input = pixels();
+    auto prepared = words(input);
+    auto perByteBuffer = wordBuffer(FRAME_SIZE, CANARY), blockBuffer = wordBuffer(FRAME_SIZE, CANARY);
+
+    SPIFrameWriter perByte(FRAME_SIZE), block(FRAME_SIZE);
+    perByte.buffer = reinterpret_cast<uint8_t *>(perByteBuffer.data());
+    block.buffer = reinterpret_cast<uint8_t *>(blockBuffer.data());
+
+    writeFrame(perByte, input.data());
+    writeBlockFrame(block, prepared.data());
+
+    TEST_ASSERT_FALSE(block.isOverrun());
+    TEST_ASSERT_EQUAL_INT(perByte.length, block.length);
+    TEST_ASSERT_EQUAL_MEMORY(perByte.buffer, block.buffer, FRAME_SIZE);
+}
+
+void test_block_overrun_writes_nothing() {
+    auto prepared = words(pixels());
+    auto buffer = wordBuffer(FRAME_SIZE, CANARY);
+    SPIFrameWriter writer(FRAME_SIZE - 1);
+    writer.buffer = reinterpret_cast<uint8_t *>(buffer.data());
+
+    writer.begin();
+    TEST_ASSERT_FALSE(writer.writeApa102Frame(prepared.data(), LED_COUNT));
+    TEST_ASSERT_TRUE(writer.isOverrun());
+    for (int i = 0; i < FRAME_SIZE; ++i)
+        TEST_ASSERT_EQUAL_UINT8(CANARY, writer.buffer[i]);
+
+    // Blocks are all or nothing, too
+    writer.begin();
+    TEST_ASSERT_TRUE(writer.writeBytes(writer.buffer, FRAME_SIZE - 2));
+    TEST_ASSERT_FALSE(writer.writeBytes(writer.buffer, 2));
+    TEST_ASSERT_TRUE(writer.isOverrun());
+    TEST_ASSERT_EQUAL_UINT8(CANARY, writer.buffer[FRAME_SIZE - 2]);
+}
+
+void benchmark_frame_writes() {
+    const int passes = 10;
+    const int framesPerPass = 2000;
+    auto input = pixels();
+    auto prepared = words(input);
+    auto buffer = wordBuffer(FRAME_SIZE, 0);
+
+    UncheckedWriter unchecked;
+    unchecked.buffer = reinterpret_cast<uint8_t *>(buffer.data());
+    SPIFrameWriter checked(FRAME_SIZE);
+    checked.buffer = unchecked.buffer;
+
+    std::function<void()> writers[] = {
+        [&]() { writeFrame(unchecked, input.data()); },
+        [&]() { writeFrame(checked, input.data()); },
+        [&]() { writeBlockFrame(checked, prepared.data()); },
+    };
+    const int writerCount = 3;
+    double nanos[writerCount] = {0};
+
+    for (auto &writer : writers)
+        writer();
+
+    // Rotate the order each pass, so none always runs first
+    for (int pass = 0; pass < passes; ++pass) {
+        for (int i = 0; i < writerCount; ++i) {
+            int w = (pass + i) % writerCount;
+
+            auto start = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < framesPerPass; ++frame)
+                writers[w]();
+            nanos[w] += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    for (auto &n : nanos)
+        n /= double(passes) * framesPerPass * LED_COUNT;
+
+    char message[128];
+    snprintf(message, sizeof(message), "per byte unchecked: %.2f, per byte checked: %.2f, block: %.2f (ns / LED)",
+             nanos[0], nanos[1], nanos[2]);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_fits_exactly);
+    RUN_TEST(test_overrun_never_writes_past_buffer);
+    RUN_TEST(test_word_is_most_significant_byte_first);
+    RUN_TEST(test_block_frame_matches_per_byte);
+    RUN_TEST(test_block_overrun_writes_nothing);
+    RUN_TEST(benchmark_frame_writes);
+    return UNITY_END();
+}